@@ -1,9 +1,23 @@
 #include <iostream>
 #include <string>
+#include <memory>
+#include <chrono>
+#include <limits>
 
 #include "src/MicroCore.h"
+#include "src/LmdbStorage.h"
 #include "src/CmdLineOptions.h"
 #include "src/tools.h"
+#include "src/RingResolver.h"
+#include "src/TxHashFileReader.h"
+#include "src/WalletScanner.h"
+#include "src/KeyImageGenerator.h"
+#include "src/ScanShard.h"
+#include "src/TxPubKeyIndex.h"
+#include "src/LmdbPrefetcher.h"
+#include "src/LmdbPageReleaser.h"
+#include "src/PaymentIdIndex.h"
+#include "src/BalanceLedger.h"
 
 
 
@@ -23,6 +37,175 @@ namespace epee {
 }
 
 
+namespace
+{
+    /**
+     * Scan outputs and inputs of a tx, either cryptonote::transaction
+     * or xmreg::indexed_tx.
+     *
+     * In the view-only mode, key images of our outputs found in
+     * earlier txs are taken from key_image_generator before inputs
+     * are checked, and outputs of this tx are given to it, so
+     * their key images are generated while next txs are scanned.
+     */
+    template <typename T>
+    bool
+    scan_tx(xmreg::WalletScanner& scanner,
+            xmreg::KeyImageGenerator* key_image_generator,
+            const T& tx,
+            xmreg::tx_scan_result& result)
+    {
+        if (!key_image_generator)
+        {
+            return scanner.scan_tx(tx, result);
+        }
+
+        if (!scanner.scan_outputs(tx, result))
+        {
+            return false;
+        }
+
+        vector<xmreg::owned_output> outputs_with_key_images;
+
+        if (!key_image_generator->wait(outputs_with_key_images))
+        {
+            return false;
+        }
+
+        for (const xmreg::owned_output& output: outputs_with_key_images)
+        {
+            scanner.add_key_image(output);
+        }
+
+        if (!scanner.scan_inputs(tx, result))
+        {
+            return false;
+        }
+
+        // outputs of this tx can't be spent in this tx,
+        // so their key images can be generated
+        // while we process next txs.
+        for (const xmreg::owned_output& output: result.outputs)
+        {
+            key_image_generator->submit(output, result.derivation);
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Print csv line of our tx. It goes to cout, as in the csv
+     * format only these lines are printed.
+     */
+    void
+    print_tx_csv(size_t tx_index,
+                 const crypto::hash& tx_hash,
+                 uint64_t received,
+                 uint64_t spent,
+                 uint64_t total_xmr_balance)
+    {
+        cout << tx_index << ","
+             << tx_hash << ","
+             << cryptonote::print_money(received) << ","
+             << cryptonote::print_money(spent) << ","
+             << cryptonote::print_money(total_xmr_balance)
+             << endl;
+    }
+
+
+    /**
+     * Print one line summary of our tx, used when
+     * scanning many txs, e.g., from the index or shards.
+     */
+    void
+    print_tx_summary(ostream& out,
+                     const string& output_format,
+                     size_t tx_index,
+                     uint64_t height,
+                     const crypto::hash& tx_hash,
+                     uint64_t received,
+                     uint64_t spent,
+                     uint64_t total_xmr_balance)
+    {
+        out << "Transaction: " << tx_index
+            << ", height: "    << height
+            << ", tx hash: "   << tx_hash << "\n"
+            << " - xmr received: " << cryptonote::print_money(received)
+            << ", xmr spent: "     << cryptonote::print_money(spent)
+            << ", total balance: " << cryptonote::print_money(total_xmr_balance)
+            << endl;
+
+        if (output_format == "csv")
+        {
+            print_tx_csv(tx_index, tx_hash, received, spent, total_xmr_balance);
+        }
+    }
+
+
+    /**
+     * Compare total balances after each of our txs with the
+     * expected ones, read from --check-balances file.
+     *
+     * Prints every mismatch, and returns false if there was any,
+     * or if the number of txs is different than expected.
+     */
+    bool
+    check_balances(ostream& out,
+                   const vector<uint64_t>& expected_balances,
+                   const vector<uint64_t>& balances)
+    {
+        bool balances_mismatch {false};
+
+        for (size_t i = 0; i < balances.size(); ++i)
+        {
+            if (i >= expected_balances.size())
+            {
+                cerr << "No expected balance for tx no: " << i + 1 << endl;
+                balances_mismatch = true;
+                break;
+            }
+
+            if (expected_balances[i] != balances[i])
+            {
+                cerr << "Balance after tx no: " << i + 1 << " is "
+                     << cryptonote::print_money(balances[i])
+                     << ", but expected "
+                     << cryptonote::print_money(expected_balances[i])
+                     << endl;
+                balances_mismatch = true;
+            }
+        }
+
+        if (balances.size() < expected_balances.size())
+        {
+            cerr << "Expected " << expected_balances.size()
+                 << " txs, but only " << balances.size() << " were checked" << endl;
+            balances_mismatch = true;
+        }
+
+        if (balances_mismatch)
+        {
+            cerr << "\nBalance check failed" << endl;
+            return false;
+        }
+
+        out << "\nBalance check passed for "
+            << expected_balances.size() << " txs" << endl;
+
+        return true;
+    }
+
+
+    void
+    print_peak_rss(ostream& out)
+    {
+        out << "\nPeak memory used: "
+            << xmreg::get_peak_rss_kb() / 1024 << " MB" << endl;
+    }
+}
+
+
 int main(int ac, const char* av[]) {
 
     // get command line options
@@ -37,7 +220,283 @@ int main(int ac, const char* av[]) {
     }
 
     // get other options
-    auto bc_path_opt  = opts.get_option<string>("bc-path");
+    auto bc_path_opt        = opts.get_option<string>("bc-path");
+    auto direct_db_opt      = opts.get_option<bool>("direct-db");
+    auto viewkey_opt        = opts.get_option<string>("viewkey");
+    auto spendkey_opt       = opts.get_option<string>("spendkey");
+    auto address_opt        = opts.get_option<string>("address");
+    auto start_height_opt   = opts.get_option<uint64_t>("start-height");
+    auto threads_opt        = opts.get_option<uint64_t>("threads");
+    auto output_format_opt  = opts.get_option<string>("output-format");
+    auto tx_hashes_file_opt = opts.get_option<string>("tx-hashes-file");
+    auto check_balances_opt = opts.get_option<string>("check-balances");
+    auto view_only_opt      = opts.get_option<bool>("view-only");
+    auto key_images_opt     = opts.get_option<string>("key-images-file");
+    auto end_height_opt     = opts.get_option<uint64_t>("end-height");
+    auto shard_out_opt      = opts.get_option<string>("shard-out");
+    auto merge_shards_opt   = opts.get_option<vector<string>>("merge-shards");
+    auto build_index_opt    = opts.get_option<string>("build-index");
+    auto index_file_opt     = opts.get_option<string>("index-file");
+    auto prefetch_opt       = opts.get_option<uint64_t>("prefetch-blocks");
+    auto payment_ids_opt    = opts.get_option<vector<string>>("payment-ids-file");
+    auto find_payment_opt   = opts.get_option<string>("find-payment-id");
+    auto ledger_file_opt    = opts.get_option<string>("ledger-file");
+    auto balance_at_opt     = opts.get_option<uint64_t>("balance-at");
+    auto memory_budget_opt  = opts.get_option<uint64_t>("memory-budget-mb");
+
+    uint64_t start_height  = *start_height_opt;
+    uint64_t no_of_threads = *threads_opt;
+    uint64_t prefetch_blocks = *prefetch_opt;
+    uint64_t memory_budget_mb = *memory_budget_opt;
+    string output_format   = *output_format_opt;
+    bool   view_only       = *view_only_opt;
+
+    if (no_of_threads == 0)
+    {
+        cerr << "Number of threads must be greater than 0" << endl;
+        return 1;
+    }
+
+    if (output_format != "text" && output_format != "csv")
+    {
+        cerr << "Unknown output format: " << output_format << endl;
+        return 1;
+    }
+
+    // in the csv format, only one line per tx is printed, so
+    // the detailed output is sent into a stream without a buffer,
+    // which just discards it.
+    ostream null_stream {nullptr};
+
+    ostream& out = output_format == "text" ? cout : null_stream;
+
+    // memory budget for parts of a scan that would otherwise
+    // grow with the number of blocks and txs scanned. each mode
+    // has only one of them, i.e., the ring member cache when
+    // scanning txs, or our outputs for the shard file, so it
+    // gets the whole budget. lmdb pages mapped by this process
+    // are dropped whenever the RSS goes over the budget.
+    uint64_t memory_budget = memory_budget_mb * 1024 * 1024;
+
+
+    // expected total balances after each tx. used to check
+    // that the scanning still gives the same results, e.g.,
+    // after changes to the code, using known wallet's history.
+    vector<uint64_t> expected_balances;
+
+    if (check_balances_opt)
+    {
+        if (!xmreg::read_balances_file(*check_balances_opt, expected_balances))
+        {
+            return 1;
+        }
+    }
+
+    // total balances after each of our txs found,
+    // compared with the expected ones at the end
+    vector<uint64_t> balances;
+
+
+    // merging shard files does not need the blockchain nor keys,
+    // as everything needed is already in the shards. the merged
+    // txs and outputs make a ledger, which can be saved, and later
+    // queried for any height range without merging the shards again.
+    if (merge_shards_opt || ledger_file_opt)
+    {
+        xmreg::BalanceLedger ledger;
+
+        if (merge_shards_opt)
+        {
+            vector<xmreg::merged_tx>     merged_txs;
+            vector<xmreg::merged_output> merged_outputs;
+
+            if (!xmreg::merge_scan_shards(*merge_shards_opt,
+                                          merged_txs, merged_outputs))
+            {
+                cerr << "Cant merge shard files" << endl;
+                return 1;
+            }
+
+            ledger.build(merged_txs, merged_outputs);
+
+            if (ledger_file_opt && !ledger.save(*ledger_file_opt))
+            {
+                return 1;
+            }
+        }
+        else if (!ledger.load(*ledger_file_opt))
+        {
+            return 1;
+        }
+
+        if (output_format == "csv")
+        {
+            cout << "tx_no,tx_hash,received,spent,balance" << endl;
+        }
+
+        // our txs between --start-height and --end-height
+        vector<xmreg::ledger_tx> ledger_txs;
+
+        ledger.history(start_height,
+                       end_height_opt ? *end_height_opt
+                                      : numeric_limits<uint64_t>::max(),
+                       ledger_txs);
+
+        size_t tx_index {0};
+
+        for (const xmreg::ledger_tx& tx: ledger_txs)
+        {
+            print_tx_summary(out, output_format, ++tx_index,
+                             tx.height, tx.tx_hash,
+                             tx.received, tx.spent,
+                             tx.balance);
+
+            balances.push_back(tx.balance);
+        }
+
+        if (balance_at_opt)
+        {
+            vector<xmreg::merged_output> unspent_outputs;
+
+            ledger.outputs_unspent_at(*balance_at_opt, unspent_outputs);
+
+            uint64_t balance_at = ledger.balance_at(*balance_at_opt);
+
+            out << "\nUnspent outputs at height " << *balance_at_opt << ":\n";
+
+            // in csv, unspent outputs and the balance
+            // follow the txs as separate tables
+            if (output_format == "csv")
+            {
+                cout << "\nheight,tx_hash,out_idx,amount" << endl;
+            }
+
+            for (const xmreg::merged_output& output: unspent_outputs)
+            {
+                out << " - height: " << output.height
+                    << ", tx hash: " << output.tx_hash
+                    << ", output no: " << output.out_idx
+                    << ", amount: " << cryptonote::print_money(output.amount)
+                    << endl;
+
+                if (output_format == "csv")
+                {
+                    cout << output.height << ","
+                         << output.tx_hash << ","
+                         << output.out_idx << ","
+                         << cryptonote::print_money(output.amount)
+                         << endl;
+                }
+            }
+
+            out << "\nBalance at height " << *balance_at_opt << ": "
+                << cryptonote::print_money(balance_at)
+                << endl;
+
+            if (output_format == "csv")
+            {
+                cout << "\nbalance_height,balance\n"
+                     << *balance_at_opt << ","
+                     << cryptonote::print_money(balance_at)
+                     << endl;
+            }
+        }
+
+        out << "\nFinal total balance: "
+            << cryptonote::print_money(
+                    ledger.balance_at(numeric_limits<uint64_t>::max()))
+            << endl;
+
+        print_peak_rss(out);
+
+        if (check_balances_opt
+            && !check_balances(out, expected_balances, balances))
+        {
+            return 1;
+        }
+
+        return 0;
+    }
+
+
+    // looking up deposits with a given payment id uses only
+    // the payment id indices saved by earlier scans, e.g.,
+    // one for each shard.
+    if (find_payment_opt)
+    {
+        if (!payment_ids_opt)
+        {
+            cerr << "--payment-ids-file must be given "
+                 << "with --find-payment-id" << endl;
+            return 1;
+        }
+
+        crypto::hash payment_id;
+        bool         encrypted;
+
+        if (!xmreg::parse_str_payment_id(*find_payment_opt,
+                                         payment_id, encrypted))
+        {
+            return 1;
+        }
+
+        // 16 hex chars are an encrypted id, 64 a plain one. they
+        // are separate, as a padded encrypted id is also a valid
+        // plain one.
+        out << "Looking up " << (encrypted ? "encrypted" : "plain")
+            << " payment id: " << *find_payment_opt << endl;
+
+        // outputs of all the files are put together
+        xmreg::PaymentIdIndex payment_id_index;
+
+        for (const string& payment_ids_file: *payment_ids_opt)
+        {
+            if (!payment_id_index.load(payment_ids_file))
+            {
+                return 1;
+            }
+        }
+
+        const vector<xmreg::owned_output>* outputs
+                = payment_id_index.find(payment_id, encrypted);
+
+        if (output_format == "csv")
+        {
+            cout << "tx_hash,out_idx,amount" << endl;
+        }
+
+        uint64_t total_received {0};
+
+        if (outputs)
+        {
+            for (const xmreg::owned_output& output: *outputs)
+            {
+                total_received += output.amount;
+
+                out << "tx hash: " << output.tx_hash
+                    << ", output no: " << output.out_idx
+                    << ", amount: " << cryptonote::print_money(output.amount)
+                    << endl;
+
+                if (output_format == "csv")
+                {
+                    cout << output.tx_hash << ","
+                         << output.out_idx << ","
+                         << cryptonote::print_money(output.amount)
+                         << endl;
+                }
+            }
+        }
+
+        out << "\nTotal xmr received with "
+            << (encrypted ? "encrypted" : "plain") << " payment id "
+            << *find_payment_opt << ": "
+            << cryptonote::print_money(total_received) << endl;
+
+        print_peak_rss(out);
+
+        return 0;
+    }
 
 
     // the default folder of the lmdb blockchain database
@@ -52,6 +511,8 @@ int main(int ac, const char* av[]) {
     // because it was much easier to work on the example. For more general
     // use, one would have to scan the blockchain to determine which
     // transactions our ours. This will be probably another example.
+    //
+    // these hashes are used only if no --tx-hashes-file is given.
     vector<string> tx_hashes_str {
             "ead7b392f57311fbac14477c4a50bee935f1dbc06bf166d219f4c011ae1dc398",
             "50a3ded2df473a7e8a7fde58c8a865d1ae246ce8ceddb5f474164888fe2ad822",
@@ -79,30 +540,38 @@ int main(int ac, const char* av[]) {
     // scanning the blockchain is required, because without this, it is not
     // possible to know which transaction outputs and inputs are associated
     // with the keys. This probably will be another example.
+    //
+    // these keys are used only if no --viewkey and --spendkey are given.
     string viewkey_str  = "9c2edec7636da3fbb343931d6c3d6e11bcd8042ff7e11de98a8d364f31976c04";
     string spendkey_str = "950b90079b0f530c11801ef29e99618d3768d79d3d24972ff4b6fd9687b7b20c";
 
+    // in the view-only mode, the private spend key is not required.
+    // the public spend key is then taken from the address.
+    bool has_spend_key {true};
 
-    // get the program command line options or default values
-    path blockchain_path = bc_path_opt ? path(*bc_path_opt) : path(default_lmdb_dir);
-
-
-    if (!is_directory(blockchain_path))
+    if (viewkey_opt || spendkey_opt)
     {
-        cerr << "Given path \"" << blockchain_path   << "\" "
-             << "is not a folder or does not exist" << " "
-             << endl;
-        return 1;
-    }
+        if (!viewkey_opt)
+        {
+            cerr << "--viewkey must be given" << endl;
+            return 1;
+        }
 
-    blockchain_path = xmreg::remove_trailing_path_separator(blockchain_path);
+        if (!spendkey_opt)
+        {
+            if (!view_only || !address_opt)
+            {
+                cerr << "--spendkey must be given, or --view-only "
+                     << "with --address" << endl;
+                return 1;
+            }
 
-    cout << "Blockchain path: " << blockchain_path << endl;
+            has_spend_key = false;
+        }
 
-    // enable basic monero log output
-    uint32_t log_level = 0;
-    epee::log_space::get_set_log_detalisation_level(true, log_level);
-    epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+        viewkey_str  = *viewkey_opt;
+        spendkey_str = spendkey_opt ? *spendkey_opt : string {};
+    }
 
 
     // parse string representing given private view key
@@ -117,7 +586,8 @@ int main(int ac, const char* av[]) {
     // parse string representing given private spend key
     crypto::secret_key private_spend_key;
 
-    if (!xmreg::parse_str_secret_key(spendkey_str, private_spend_key))
+    if (has_spend_key
+        && !xmreg::parse_str_secret_key(spendkey_str, private_spend_key))
     {
         cerr << "Cant parse spend key: " << spendkey_str << endl;
         return 1;
@@ -130,7 +600,10 @@ int main(int ac, const char* av[]) {
 
 
     // generate public key based on the private key
-    crypto::secret_key_to_public_key(private_spend_key, public_spend_key);
+    if (has_spend_key)
+    {
+        crypto::secret_key_to_public_key(private_spend_key, public_spend_key);
+    }
 
 
     // we have private_view_key, so now we need to get the corresponding
@@ -145,11 +618,42 @@ int main(int ac, const char* av[]) {
     cryptonote::account_public_address address {public_spend_key, public_view_key};
 
 
+    // if address was given, make sure that it
+    // corresponds to the keys provided
+    if (address_opt)
+    {
+        cryptonote::account_public_address given_address;
+
+        if (!xmreg::parse_str_address(*address_opt, given_address))
+        {
+            cerr << "Cant parse address: " << *address_opt << endl;
+            return 1;
+        }
+
+        // without the private spend key, the address
+        // is the only source of the public spend key
+        if (!has_spend_key)
+        {
+            public_spend_key = given_address.m_spend_public_key;
+            address.m_spend_public_key = public_spend_key;
+        }
+
+        if (given_address.m_spend_public_key != address.m_spend_public_key
+            || given_address.m_view_public_key != address.m_view_public_key)
+        {
+            cerr << "Given address does not match the given keys: "
+                 << *address_opt << endl;
+            return 1;
+        }
+    }
+
+
     // 25 word mnemonic that is provided by the simplewallet
     string mnemonic_str;
 
     // derive the mnemonic version of the spend key.
-    if (!crypto::ElectrumWords::bytes_to_words(private_spend_key, mnemonic_str, language))
+    if (has_spend_key
+        && !crypto::ElectrumWords::bytes_to_words(private_spend_key, mnemonic_str, language))
     {
         cerr << "\nCant create the mnemonic for the private spend key: "
              << private_spend_key << endl;
@@ -157,68 +661,468 @@ int main(int ac, const char* av[]) {
     }
 
 
-    // create instance of our MicroCore
-    xmreg::MicroCore mcore;
+    // scanner that checks which outputs and inputs are ours.
+    //
+    // this is the most tricky part of the example.
+    // the reason is that by simply looking at individual transactions
+    // it is not possible to know which inputs are ours, even if
+    // we have private view and spend keys. we can do this with outputs
+    // but inputs. so how do you know which outputs in a given transactions
+    // are ours? the answer is that we need to keep track of all our
+    // previous outputs. In other words, the key_images listed in inputs
+    // of a given transaction will correspond (if they belongs to us)
+    // to some key images derived from our past outputs. the scanner
+    // keeps these key images for us.
+    //
+    // in the view-only mode, the scanner does not use the private
+    // spend key, and only finds our outputs. their key images are
+    // obtained by key_image_generator in background threads, while
+    // we read and scan next txs.
+    unique_ptr<xmreg::WalletScanner> scanner;
+
+    unique_ptr<xmreg::KeyImageGenerator> key_image_generator;
+
+    if (view_only)
+    {
+        scanner.reset(new xmreg::WalletScanner(private_view_key, public_spend_key));
+
+        key_image_generator.reset(new xmreg::KeyImageGenerator(no_of_threads));
+
+        if (has_spend_key)
+        {
+            key_image_generator->set_private_spend_key(private_spend_key);
+        }
+
+        if (key_images_opt
+            && !key_image_generator->import_key_images(*key_images_opt))
+        {
+            return 1;
+        }
+
+        // no key image can be known then, so every spending is
+        // missed and the balances printed are only what was received
+        if (!has_spend_key && !key_images_opt)
+        {
+            cerr << "Warning: without --spendkey or --key-images-file, "
+                 << "spendings can't be found in the view-only mode. "
+                 << "Balances are only the total received." << endl;
+        }
+    }
+    else
+    {
+        scanner.reset(new xmreg::WalletScanner(private_view_key, private_spend_key));
+    }
+
+    // our outputs of txs with payment ids are collected
+    // by the scanner, and saved when the scan is done, so that
+    // deposits can be found later with --find-payment-id.
+    shared_ptr<xmreg::PaymentIdIndex> payment_id_index;
+
+    string payment_ids_file;
+
+    if (payment_ids_opt)
+    {
+        if (payment_ids_opt->size() != 1)
+        {
+            cerr << "Only one --payment-ids-file can be "
+                 << "written by a scan" << endl;
+            return 1;
+        }
+
+        payment_ids_file = payment_ids_opt->front();
+
+        payment_id_index = make_shared<xmreg::PaymentIdIndex>();
+        scanner->set_payment_id_index(payment_id_index);
+    }
+
+    auto save_payment_ids = [&]() -> bool
+    {
+        if (!payment_id_index)
+        {
+            return true;
+        }
+
+        if (!payment_id_index->save(payment_ids_file))
+        {
+            return false;
+        }
+
+        out << "\nSaved " << payment_id_index->no_of_outputs()
+            << " outputs with " << payment_id_index->size()
+            << " payment ids into " << payment_ids_file << endl;
+
+        return true;
+    };
+
+    // scan txs in the tx public key index file, made earlier
+    // with --build-index. the index has everything needed for
+    // finding our outputs and inputs, so the blockchain is not used.
+    if (index_file_opt)
+    {
+        // the index has no tx extra, so
+        // payment ids can't be found there
+        if (payment_ids_opt)
+        {
+            cerr << "--payment-ids-file can't be used with --index-file" << endl;
+            return 1;
+        }
+
+        xmreg::TxPubKeyIndex tx_index_file;
+
+        if (!tx_index_file.open(*index_file_opt))
+        {
+            return 1;
+        }
+
+        if (output_format == "csv")
+        {
+            cout << "tx_no,tx_hash,received,spent,balance" << endl;
+        }
+
+        uint64_t total_xmr_balance {0};
+        size_t   tx_index          {0};
+
+        xmreg::tx_scan_result result;
+
+        for (uint64_t i = 0; i < tx_index_file.size(); ++i)
+        {
+            xmreg::indexed_tx tx = tx_index_file.get_tx(i);
+
+            if (tx.entry->height < start_height)
+            {
+                continue;
+            }
+
+            if (!scan_tx(*scanner, key_image_generator.get(), tx, result))
+            {
+                return 1;
+            }
+
+            if (!result.is_ours())
+            {
+                continue;
+            }
+
+            total_xmr_balance += result.received;
+            total_xmr_balance -= result.spent;
+
+            print_tx_summary(out, output_format, ++tx_index,
+                             tx.entry->height, result.tx_hash,
+                             result.received, result.spent,
+                             total_xmr_balance);
+
+            balances.push_back(total_xmr_balance);
+        }
+
+        out << "\nFinal total balance: "
+            << cryptonote::print_money(total_xmr_balance) << endl;
+
+        print_peak_rss(out);
+
+        if (check_balances_opt
+            && !check_balances(out, expected_balances, balances))
+        {
+            return 1;
+        }
+
+        return 0;
+    }
+
+
+    // get the program command line options or default values
+    path blockchain_path = bc_path_opt ? path(*bc_path_opt) : path(default_lmdb_dir);
+
 
-    // initialize the core using the blockchain path
-    if (!mcore.init(blockchain_path.string()))
+    if (!is_directory(blockchain_path))
     {
-        cerr << "Error accessing blockchain." << endl;
+        cerr << "Given path \"" << blockchain_path   << "\" "
+             << "is not a folder or does not exist" << " "
+             << endl;
         return 1;
     }
 
+    blockchain_path = xmreg::remove_trailing_path_separator(blockchain_path);
 
-    cout << "\n"
-         << "Private spend key: " << private_spend_key << "\n"
-         << "Public spend key : " << public_spend_key  << endl;
+    out << "Blockchain path: " << blockchain_path << endl;
 
-    cout << "\n"
-         << "Private view key : "  << private_view_key << "\n"
-         << "Public view key  : "  << public_view_key  << endl;
+    // enable basic monero log output
+    uint32_t log_level = 0;
+    epee::log_space::get_set_log_detalisation_level(true, log_level);
+    epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
 
 
-    cout << "\n"
-         << "Monero address   : "  << address << endl;
 
-    cout << "\n"
-         << "Mnemonic seed    : "  << mnemonic_str << endl;
+    // we only read blocks and txs, so the database can be
+    // opened directly with LmdbStorage. MicroCore is still
+    // the default, as it was used in the original example.
+    unique_ptr<xmreg::MicroCore>   mcore;
+    unique_ptr<xmreg::LmdbStorage> lmdb_storage;
 
+    auto init_start = chrono::steady_clock::now();
+
+    if (*direct_db_opt)
+    {
+        lmdb_storage.reset(new xmreg::LmdbStorage());
+
+        // initialize only the lmdb database
+        if (!lmdb_storage->init(blockchain_path.string()))
+        {
+            cerr << "Error accessing blockchain." << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        // create instance of our MicroCore
+        mcore.reset(new xmreg::MicroCore());
 
+        // initialize the core using the blockchain path
+        if (!mcore->init(blockchain_path.string()))
+        {
+            cerr << "Error accessing blockchain." << endl;
+            return 1;
+        }
+    }
 
-    // get the high level cryptonote::Blockchain object to interact
-    // with the blockchain lmdb database
-    cryptonote::Blockchain& core_storage = mcore.get_core();
+    auto init_time = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - init_start);
 
-    vector<cryptonote::transaction> txs;
+    out << "Blockchain opened in " << init_time.count() << " ms using "
+        << (lmdb_storage ? "LmdbStorage" : "MicroCore") << endl;
 
-    // populate transactions vector using
-    // tx hashes provided above
-    for (const string& tx_hash_str: tx_hashes_str)
+
+    if (has_spend_key)
     {
-        cryptonote::transaction tx;
+        out << "\n"
+            << "Private spend key: " << private_spend_key << "\n";
+    }
+
+    out << "\n"
+        << "Public spend key : " << public_spend_key  << endl;
 
-        if (!xmreg::get_tx_from_str_hash(core_storage, tx_hash_str, tx))
+    out << "\n"
+        << "Private view key : "  << private_view_key << "\n"
+        << "Public view key  : "  << public_view_key  << endl;
+
+
+    out << "\n"
+        << "Monero address   : "  << address << endl;
+
+    if (has_spend_key)
+    {
+        out << "\n"
+            << "Mnemonic seed    : "  << mnemonic_str << endl;
+    }
+
+
+
+    // get the lmdb database, either directly or through
+    // the high level cryptonote::Blockchain object
+    cryptonote::BlockchainDB& blockchain_db = lmdb_storage
+                                              ? lmdb_storage->get_db()
+                                              : mcore->get_core().get_db();
+
+    // tx hashes are read from the file one by one, as it can be
+    // very large. if no file is given, we use the hardcoded hashes.
+    unique_ptr<xmreg::TxHashFileReader> tx_hashes_file;
+
+    if (tx_hashes_file_opt)
+    {
+        tx_hashes_file.reset(new xmreg::TxHashFileReader(*tx_hashes_file_opt));
+
+        if (!tx_hashes_file->is_open())
         {
-            cerr << "Cant find transaction with hash: " << tx_hash_str << endl;
             return 1;
         }
+    }
+
+    vector<string>::const_iterator tx_hashes_it = tx_hashes_str.begin();
+
+    // get next tx hash to check, either from the file
+    // or from the hardcoded tx_hashes_str
+    auto next_tx_hash = [&](string& tx_hash_str) -> bool
+    {
+        if (tx_hashes_file)
+        {
+            return tx_hashes_file->next(tx_hash_str);
+        }
 
-        txs.push_back(tx);
+        if (tx_hashes_it == tx_hashes_str.end())
+        {
+            return false;
+        }
+
+        tx_hash_str = *tx_hashes_it++;
+
+        return true;
+    };
+
+    if (output_format == "csv")
+    {
+        cout << "tx_no,tx_hash,received,spent,balance" << endl;
     }
 
-    // store key images generated using our outputs
-    // and our private spend key.
-    //
-    // this is the most tricky part of the example.
-    // the reason is that by simply looking at individual transactions
-    // it is not possible to know which inputs are ours, even if
-    // we have private view and spend keys. we can do this with outputs
-    // but inputs. so how do you know which outputs in a given transactions
-    // are ours? the answer is that we need to keep track of all our
-    // previous outputs. In other words, the key_images listed in inputs
-    // of a given transaction will correspond (if they belongs to us)
-    // to some key images derived from our past outputs
-    vector<crypto::key_image> key_images;
+    // blocks used by --build-index and --shard-out
+    uint64_t end_height = end_height_opt
+                          ? min(*end_height_opt, blockchain_db.height())
+                          : blockchain_db.height();
+
+    // keeps lmdb pages of a long scan within the memory budget
+    unique_ptr<xmreg::LmdbPageReleaser> page_releaser;
+
+    if (memory_budget > 0)
+    {
+        page_releaser.reset(new xmreg::LmdbPageReleaser(memory_budget));
+
+        if (!page_releaser->open(blockchain_path.string()))
+        {
+            page_releaser.reset();
+        }
+    }
+
+    auto print_page_releases = [&]()
+    {
+        if (page_releaser)
+        {
+            out << "\nlmdb pages dropped " << page_releaser->no_of_releases()
+                << " times to stay within the memory budget" << endl;
+        }
+    };
+
+    // reads blocks and txs ahead of the ones scanned with
+    // --build-index and --shard-out, if --prefetch-blocks is given.
+    // how much of the lmdb file is in memory before and after
+    // the scan, i.e., if it was cold or warm, is printed with
+    // the scan time, so runs with and without it can be compared.
+    unique_ptr<xmreg::LmdbPrefetcher> prefetcher;
+
+    string data_file_path = blockchain_path.string() + "/data.mdb";
+
+    auto print_resident_fraction = [&](const string& when)
+    {
+        out << "\nlmdb file " << when << " the scan: "
+            << static_cast<int>(100 * xmreg::get_resident_fraction(data_file_path))
+            << "% of its pages are in memory" << endl;
+    };
+
+    if (build_index_opt || shard_out_opt)
+    {
+        if (start_height >= end_height)
+        {
+            cerr << "No blocks to scan between heights "
+                 << start_height << " and " << end_height << endl;
+            return 1;
+        }
+
+        print_resident_fraction("before");
+
+        if (prefetch_blocks > 0)
+        {
+            prefetcher.reset(new xmreg::LmdbPrefetcher(blockchain_db,
+                                                       prefetch_blocks));
+        }
+    }
+
+    auto scan_start = chrono::steady_clock::now();
+
+    // prints how long it took to scan the blocks
+    auto print_scan_time = [&]()
+    {
+        double seconds = chrono::duration_cast<chrono::duration<double>>(
+                chrono::steady_clock::now() - scan_start).count();
+
+        if (prefetcher)
+        {
+            prefetcher->finish();
+        }
+
+        out << "\nScanned " << end_height - start_height << " blocks in "
+            << seconds << " s ("
+            << (end_height - start_height) / max(seconds, 1e-3)
+            << " blocks/s), prefetching "
+            << (prefetcher ? to_string(prefetch_blocks) + " blocks ahead"
+                           : string("off"))
+            << endl;
+
+        print_resident_fraction("after");
+
+        print_page_releases();
+
+        print_peak_rss(out);
+    };
+
+    // one time pass over the blockchain, writing public keys,
+    // outputs and key images of all txs into the index file.
+    // later scans, e.g., for other wallets, can use only
+    // the index with --index-file.
+    if (build_index_opt)
+    {
+        out << "\nIndexing blocks " << start_height << " to "
+            << end_height << " into " << *build_index_opt << endl;
+
+        if (!xmreg::build_tx_pubkey_index(blockchain_db, start_height,
+                                          end_height, *build_index_opt,
+                                          prefetcher.get(),
+                                          page_releaser.get()))
+        {
+            return 1;
+        }
+
+        print_scan_time();
+
+        out << "\nIndex written." << endl;
+
+        return 0;
+    }
+
+    // scan a range of blocks, rather than given txs, and write
+    // the results into a shard file. many such shards can be made
+    // in parallel, e.g., by separate processes using the same
+    // blockchain, and then combined with --merge-shards.
+    if (shard_out_opt)
+    {
+        if (view_only)
+        {
+            cerr << "Key images are needed for shards, so "
+                 << "--view-only can't be used with --shard-out" << endl;
+            return 1;
+        }
+
+        xmreg::ScanShardWriter shard_writer {*shard_out_opt, address,
+                                             start_height, end_height};
+
+        if (!shard_writer.is_open())
+        {
+            return 1;
+        }
+
+        shard_writer.set_memory_budget(memory_budget);
+
+        out << "\nScanning blocks " << start_height << " to "
+            << end_height << " into " << *shard_out_opt << endl;
+
+        if (!xmreg::scan_height_range(blockchain_db, *scanner,
+                                      start_height, end_height,
+                                      shard_writer, prefetcher.get(),
+                                      page_releaser.get())
+            || !shard_writer.close()
+            || !save_payment_ids())
+        {
+            return 1;
+        }
+
+        print_scan_time();
+
+        out << "\nShard written. Use --merge-shards to get balances." << endl;
+
+        return 0;
+    }
+
+    // resolves ring members of inputs (i.e., their key_offsets)
+    // into tx hashes and output indices. it caches global output
+    // indices that were already looked up, as the same outputs
+    // are used as ring members many times.
+    xmreg::RingResolver ring_resolver {blockchain_db, memory_budget};
 
     // total xmr balance
     uint64_t total_xmr_balance {0};
@@ -231,8 +1135,7 @@ int main(int ac, const char* av[]) {
     // for each output, check if it belongs to us, based
     // on our private view key. If so, then get the xmr amount
     // sent to us, and also generate key image for this output.
-    // key images are generated using our public spend key. each generated
-    // key image, is stored in a key_images vector.
+    // key images are generated using our public spend key.
     //
     // after we are done with outputs, we go to check inputs. inputs
     // are our spendings, but which input is ours? for this, we need
@@ -243,202 +1146,247 @@ int main(int ac, const char* av[]) {
     // when we spend xmr, inputs used will add up to no less than
     // what we spend. Thus, if they they are more than what we spend
     // we will get back a change in the outputs of the current transaction.
-    for (const cryptonote::transaction& tx: txs)
+    string tx_hash_str;
+
+    while (next_tx_hash(tx_hash_str))
     {
-        cout << "\n\n"
-             << "********************************************************************\n"
-             << "Transaction: " << ++tx_index << "\n"
-             << "********************************************************************"
-             << endl;
+        if (page_releaser)
+        {
+            page_releaser->check();
+        }
 
-        // get tx public key from extras field
-        crypto::public_key pub_tx_key = cryptonote::get_tx_pub_key_from_extra(tx);
+        cryptonote::transaction tx;
 
-        if (pub_tx_key == cryptonote::null_pkey)
+        if (!xmreg::get_tx_from_str_hash(blockchain_db, tx_hash_str, tx))
         {
-            cerr << "Cant get public key of tx with hash: "
-                 << cryptonote::get_transaction_hash(tx)
-                 << endl;
+            cerr << "Cant find transaction with hash: " << tx_hash_str;
+
+            if (tx_hashes_file)
+            {
+                cerr << " (line " << tx_hashes_file->line_no()
+                     << " of " << *tx_hashes_file_opt << ")";
+            }
 
+            cerr << endl;
             return 1;
         }
 
+        if (start_height > 0)
+        {
+            uint64_t tx_height = blockchain_db.get_tx_block_height(
+                    cryptonote::get_transaction_hash(tx));
+
+            if (tx_height < start_height)
+            {
+                continue;
+            }
+        }
 
-        // public transaction key is combined with our private view key
-        // to create, so called, derived key.
-        crypto::key_derivation derivation;
+        out << "\n\n"
+            << "********************************************************************\n"
+            << "Transaction: " << ++tx_index << "\n"
+            << "********************************************************************"
+            << endl;
 
-        if (!generate_key_derivation(pub_tx_key, private_view_key, derivation))
-        {
-            cerr << "Cant get dervied key for: " << "\n"
-                 << "pub_tx_key: " << private_view_key << " and "
-                 << "private_view_key" << private_view_key << endl;
+        xmreg::tx_scan_result result;
 
+        if (!scan_tx(*scanner, key_image_generator.get(), tx, result))
+        {
             return 1;
         }
 
+        // txs given by hash are expected to be ours, so
+        // not being able to check their outputs is an error
+        if (!result.has_derivation)
+        {
+            cerr << "Cant get public key or derived key of tx with hash: "
+                 << result.tx_hash << endl;
+            return 1;
+        }
 
         // lets check our keys
-        cout << "\n"
-             << "tx hash          : " << cryptonote::get_transaction_hash(tx) << "\n"
-             << "public tx key    : "  << pub_tx_key << "\n"
-             << "derived key      : "  << derivation << "\n" << endl;
+        out << "\n"
+            << "tx hash          : " << result.tx_hash    << "\n"
+            << "public tx key    : " << result.tx_pub_key << "\n"
+            << "derived key      : " << result.derivation << "\n";
 
+        if (result.has_payment_id)
+        {
+            out << "payment id       : " << result.payment_id
+                << (result.payment_id_encrypted ? " (encrypted)" : "") << "\n";
+        }
 
-        //
-        // check outputs to for incoming xmr
-        //
+        out << endl;
 
-        // get the total number of outputs in a transaction.
-        size_t output_no = tx.vout.size();
 
-        // sum amount of xmr sent to us
-        // in the given transaction
-        uint64_t money_received {0};
+        //
+        // print outputs, marking the ones that are ours
+        //
 
+        vector<xmreg::owned_output>::const_iterator owned_it
+                = result.outputs.begin();
 
-        // loop through outputs in the given tx
-        // to check which outputs our ours. for each our output,
-        // we get xmr amount sent to us, and we generate its key image.
-        // the key images generated stored in
-        // the global key_images vector.
-        for (size_t i = 0; i < output_no; ++i)
+        for (size_t i = 0; i < tx.vout.size(); ++i)
         {
-            // get the tx output public key
-            crypto::public_key pubkey;
-
-            crypto::derive_public_key(derivation, i,
-                                      public_spend_key,
-                                      pubkey);
-
             // get tx output public key
-            cryptonote::txout_to_key tx_out_to_key
+            const cryptonote::txout_to_key& tx_out_to_key
                     = boost::get<cryptonote::txout_to_key>(tx.vout[i].target);
 
+            out << "Output no: " << i << ", " << tx_out_to_key.key;
 
-            cout << "Output no: " << i << ", " << tx_out_to_key.key;
-
-            // check if the output's public key is ours
-            if (tx_out_to_key.key == pubkey)
+            // owned outputs are in the order of their indices
+            if (owned_it != result.outputs.end() && owned_it->out_idx == i)
             {
-                // generate key_image of this output
-                crypto::key_image key_image;
-
-                if (!xmreg::generate_key_image(derivation, i,
-                                               private_spend_key,
-                                               public_spend_key,
-                                               key_image))
+                if (owned_it->has_key_image)
                 {
-                    cerr << "Cant generate key image for tx: "
-                         << cryptonote::get_transaction_hash(tx) << endl;
-
-                    return 1;
+                    out << ", key_image: " << owned_it->key_image;
                 }
 
-                // push to global vector to use it later for checking
-                // for our inputs (i.e. spend xmr)
-                key_images.push_back(key_image);
+                out << ", mine key: " << cryptonote::print_money(owned_it->amount)
+                    << endl;
 
-                cout << ", key_image: " << key_image;
-
-                // if so, then add the xmr amount to the money_transfered
-                money_received += tx.vout[i].amount;
-
-                cout << ", mine key: " << cryptonote::print_money(tx.vout[i].amount) << endl;
+                ++owned_it;
             }
             else
             {
-                cout << ", not mine key " << endl;
+                out << ", not mine key " << endl;
             }
         }
 
-        cout << "\nTotal xmr received: " << cryptonote::print_money(money_received) << endl;
+        out << "\nTotal xmr received: " << cryptonote::print_money(result.received) << endl;
+
 
         //
-        // check inputs for spend xmr
+        // print inputs, marking the ones that are ours
         //
 
-        // get the total number of inputs in a transaction.
-        // some of these inputs might be our spendings
-        size_t input_no = tx.vin.size();
-
-        // sum amount of xmr sent by us
-        // in the given transaction
-        uint64_t money_spend {0};
+        out << endl;
 
-        cout << endl;
+        vector<xmreg::spent_input>::const_iterator spent_it
+                = result.inputs.begin();
 
-        for (size_t i = 0; i < input_no; ++i)
+        for (size_t i = 0; i < tx.vin.size(); ++i)
         {
             // get tx input key
             const cryptonote::txin_to_key& tx_in_to_key
                     = boost::get<cryptonote::txin_to_key>(tx.vin[i]);
 
-            // check if the public key image of this input
-            // matches any of your key images that were
-            // generated for every output that we received
-            std::vector<crypto::key_image>::iterator it;
+            out << "Input no: " << i << ", " << tx_in_to_key.k_image;
+
+            // spent inputs are in the order of their indices
+            if (spent_it == result.inputs.end() || spent_it->in_idx != i)
+            {
+                out << ", not mine key image " << endl;
+                continue;
+            }
+
+            out << ", mine key image: "
+                << cryptonote::print_money(spent_it->amount) << endl;
 
-            it = find(key_images.begin(), key_images.end(), tx_in_to_key.k_image);
+            // our output that this key image was generated from
+            const cryptonote::tx_out_index& spent_output = spent_it->spent_output;
 
-            cout << ""
-                 << "Input no: " << i << ", " << tx_in_to_key.k_image;
+            ++spent_it;
 
-            if (it != key_images.end())
+            // find the position of our output among
+            // the ring members of this input
+            vector<cryptonote::tx_out_index> ring_members;
+
+            if (!ring_resolver.resolve(tx_in_to_key, ring_members))
             {
-                // if so, then add the xmr amount to the money_spend
-                money_spend += tx_in_to_key.amount;
+                cerr << "Cant resolve ring members of input no: " << i << endl;
+                return 1;
+            }
+
+            auto ring_it = find(ring_members.begin(), ring_members.end(),
+                                spent_output);
+
+            out << " - spends output no: " << spent_output.second
+                << " of tx: " << spent_output.first;
 
-                cout << ", mine key image: "
-                     << cryptonote::print_money(tx_in_to_key.amount) << endl;
+            if (ring_it != ring_members.end())
+            {
+                out << " (ring member " << (ring_it - ring_members.begin()) + 1
+                    << " of " << ring_members.size() << ")" << endl;
             }
             else
             {
-                cout << ", not mine key image " << endl;
+                out << " (not found among "
+                    << ring_members.size() << " ring members)" << endl;
             }
         }
 
-        cout << "\nTotal xmr spend: " << cryptonote::print_money(money_spend) << endl;
+        out << "\nTotal xmr spend: " << cryptonote::print_money(result.spent) << endl;
 
 
         //
         // Print summary for the current tx
         //
 
-        cout << "\nSummary for tx: " << cryptonote::get_transaction_hash(tx) << endl;
+        out << "\nSummary for tx: " << result.tx_hash << endl;
 
-        if (money_received > money_spend)
+        if (result.received > result.spent)
         {
-            uint64_t xmr_diff = money_received - money_spend;
+            uint64_t xmr_diff = result.received - result.spent;
 
             total_xmr_balance += xmr_diff;
 
-            cout << " - xmr received: " << cryptonote::print_money(xmr_diff) << endl;
+            out << " - xmr received: " << cryptonote::print_money(xmr_diff) << endl;
         }
         else
         {
-            uint64_t xmr_diff = money_spend - money_received;
+            uint64_t xmr_diff = result.spent - result.received;
 
             // get tx fee
             uint64_t tx_fee = cryptonote::get_tx_fee(tx);
 
             total_xmr_balance -= xmr_diff;
 
-            cout << "- xmr spent: " << cryptonote::print_money(xmr_diff)
-                 << " (includes tx fee: " << cryptonote::print_money(tx_fee) << ")"
-                 << endl;
+            out << "- xmr spent: " << cryptonote::print_money(xmr_diff)
+                << " (includes tx fee: " << cryptonote::print_money(tx_fee) << ")"
+                << endl;
         }
 
-        cout << "\nAfter this tx, total balance is: "
-             << cryptonote::print_money(total_xmr_balance)
-             << endl;
+        out << "\nAfter this tx, total balance is: "
+            << cryptonote::print_money(total_xmr_balance)
+            << endl;
+
+        balances.push_back(total_xmr_balance);
+
+        // the detailed output above is the text format
+        // version of print_tx_summary()
+        if (output_format == "csv")
+        {
+            print_tx_csv(tx_index, result.tx_hash,
+                         result.received, result.spent,
+                         total_xmr_balance);
+        }
     }
 
 
     // print total xmr balance of after all processing all xmr received and xmr spend.
-    cout << "\nFinal total balance: " << cryptonote::print_money(total_xmr_balance) << endl;
+    out << "\nFinal total balance: " << cryptonote::print_money(total_xmr_balance) << endl;
+
+    out << "\nRing member lookups: " << ring_resolver.cache_misses()
+        << " from the database, " << ring_resolver.cache_hits()
+        << " from the cache" << endl;
+
+    if (!save_payment_ids())
+    {
+        return 1;
+    }
+
+    print_page_releases();
+
+    print_peak_rss(out);
+
+    if (check_balances_opt
+        && !check_balances(out, expected_balances, balances))
+    {
+        return 1;
+    }
 
-    cout << "\nEnd of program." << endl;
+    out << "\nEnd of program." << endl;
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,338 @@
+#include "BalanceLedger.h"
+#include "tools.h"
+
+#include <algorithm>
+
+namespace xmreg
+{
+
+    namespace
+    {
+        // first bytes of every ledger file
+        const char LEDGER_MAGIC[8] = {'X', 'M', 'R', 'L', 'D', 'G', 'R', '1'};
+
+        // for binary search of the first tx after a height
+        bool
+        height_before_tx(uint64_t height, const ledger_tx& tx)
+        {
+            return height < tx.height;
+        }
+
+        // for binary search of the first tx at or after a height
+        bool
+        tx_before_height(const ledger_tx& tx, uint64_t height)
+        {
+            return tx.height < height;
+        }
+    }
+
+
+    /**
+     * Build the ledger from results of merge_scan_shards(),
+     * which are already in the blockchain order.
+     */
+    void
+    BalanceLedger::build(const vector<merged_tx>& txs,
+                         const vector<merged_output>& outputs)
+    {
+        m_txs.clear();
+        m_txs.reserve(txs.size());
+
+        uint64_t balance {0};
+
+        for (const merged_tx& tx: txs)
+        {
+            balance += tx.received;
+            balance -= tx.spent;
+
+            m_txs.push_back({tx.height, tx.tx_no, tx.tx_hash,
+                             tx.received, tx.spent, balance});
+        }
+
+        m_outputs = outputs;
+
+        build_unspent_tree();
+    }
+
+
+    /**
+     * Total balance after all our txs in blocks
+     * up to and including the given height.
+     */
+    uint64_t
+    BalanceLedger::balance_at(uint64_t height) const
+    {
+        auto it = upper_bound(m_txs.begin(), m_txs.end(),
+                              height, height_before_tx);
+
+        if (it == m_txs.begin())
+        {
+            return 0;
+        }
+
+        return prev(it)->balance;
+    }
+
+
+    /**
+     * Our outputs that were unspent after the block at the given
+     * height, in the blockchain order.
+     *
+     * The height falls into one leaf of the segment tree, and
+     * each output unspent there is in exactly one node on the
+     * path from that leaf to the root. So this is O(log n) in
+     * the number of our outputs, plus sorting the k found.
+     */
+    void
+    BalanceLedger::outputs_unspent_at(uint64_t height,
+                                      vector<merged_output>& outputs) const
+    {
+        outputs.clear();
+
+        auto it = upper_bound(m_heights.begin(), m_heights.end(), height);
+
+        if (it == m_heights.begin())
+        {
+            return;
+        }
+
+        vector<size_t> found;
+
+        size_t node = (it - m_heights.begin() - 1) + m_heights.size();
+
+        for (; node > 0; node /= 2)
+        {
+            found.insert(found.end(),
+                         m_unspent_tree[node].begin(),
+                         m_unspent_tree[node].end());
+        }
+
+        sort(found.begin(), found.end());
+
+        for (size_t i: found)
+        {
+            outputs.push_back(m_outputs[i]);
+        }
+    }
+
+
+    /**
+     * Our txs in blocks from start_height
+     * up to, but not including, end_height.
+     */
+    void
+    BalanceLedger::history(uint64_t start_height, uint64_t end_height,
+                           vector<ledger_tx>& txs) const
+    {
+        txs.clear();
+
+        if (start_height >= end_height)
+        {
+            return;
+        }
+
+        auto first = lower_bound(m_txs.begin(), m_txs.end(),
+                                 start_height, tx_before_height);
+
+        auto last  = lower_bound(first, m_txs.end(),
+                                 end_height, tx_before_height);
+
+        txs.assign(first, last);
+    }
+
+
+    uint64_t
+    BalanceLedger::size() const
+    {
+        return m_txs.size();
+    }
+
+
+    /**
+     * The file has the magic, number of txs and of outputs,
+     * and then the txs and the outputs.
+     */
+    bool
+    BalanceLedger::save(const string& file_path) const
+    {
+        ofstream file(file_path, ios::binary | ios::trunc);
+
+        if (!file.is_open())
+        {
+            cerr << "Cant open ledger file for writing: " << file_path << endl;
+            return false;
+        }
+
+        file.write(LEDGER_MAGIC, sizeof(LEDGER_MAGIC));
+
+        write_pod(file, static_cast<uint64_t>(m_txs.size()));
+        write_pod(file, static_cast<uint64_t>(m_outputs.size()));
+
+        for (const ledger_tx& tx: m_txs)
+        {
+            write_pod(file, tx.height);
+            write_pod(file, tx.tx_no);
+            write_pod(file, tx.tx_hash);
+            write_pod(file, tx.received);
+            write_pod(file, tx.spent);
+            write_pod(file, tx.balance);
+        }
+
+        for (const merged_output& output: m_outputs)
+        {
+            write_pod(file, output.height);
+            write_pod(file, output.tx_no);
+            write_pod(file, output.tx_hash);
+            write_pod(file, output.out_idx);
+            write_pod(file, output.amount);
+            write_pod(file, output.key_image);
+            write_pod(file, output.spent_height);
+        }
+
+        file.close();
+
+        if (file.fail())
+        {
+            cerr << "Error writing ledger file: " << file_path << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+
+    bool
+    BalanceLedger::load(const string& file_path)
+    {
+        ifstream file(file_path, ios::binary);
+
+        if (!file.is_open())
+        {
+            cerr << "Cant open ledger file: " << file_path << endl;
+            return false;
+        }
+
+        char magic[sizeof(LEDGER_MAGIC)];
+
+        if (!file.read(magic, sizeof(magic))
+            || !equal(begin(magic), end(magic), begin(LEDGER_MAGIC)))
+        {
+            cerr << "Not a ledger file: " << file_path << endl;
+            return false;
+        }
+
+        uint64_t no_of_txs;
+        uint64_t no_of_outputs;
+
+        if (!(read_pod(file, no_of_txs)
+              && read_pod(file, no_of_outputs)))
+        {
+            cerr << "Cant read ledger file: " << file_path << endl;
+            return false;
+        }
+
+        m_txs.clear();
+        m_outputs.clear();
+
+        for (uint64_t i = 0; i < no_of_txs; ++i)
+        {
+            ledger_tx tx;
+
+            if (!(read_pod(file, tx.height)
+                  && read_pod(file, tx.tx_no)
+                  && read_pod(file, tx.tx_hash)
+                  && read_pod(file, tx.received)
+                  && read_pod(file, tx.spent)
+                  && read_pod(file, tx.balance)))
+            {
+                cerr << "Cant read txs from ledger file: " << file_path << endl;
+                return false;
+            }
+
+            m_txs.push_back(tx);
+        }
+
+        for (uint64_t i = 0; i < no_of_outputs; ++i)
+        {
+            merged_output output;
+
+            if (!(read_pod(file, output.height)
+                  && read_pod(file, output.tx_no)
+                  && read_pod(file, output.tx_hash)
+                  && read_pod(file, output.out_idx)
+                  && read_pod(file, output.amount)
+                  && read_pod(file, output.key_image)
+                  && read_pod(file, output.spent_height)))
+            {
+                cerr << "Cant read outputs from ledger file: " << file_path << endl;
+                return false;
+            }
+
+            m_outputs.push_back(output);
+        }
+
+        build_unspent_tree();
+
+        return true;
+    }
+
+
+    /**
+     * Leaf i of the tree stands for heights from m_heights[i] up
+     * to, but not including, m_heights[i + 1]. No output is
+     * received or spent within it, so all its heights have the
+     * same unspent outputs. Interval of each output is added to
+     * the O(log n) nodes that cover it, as in a bottom-up
+     * segment tree with the leaves at [n, 2n).
+     */
+    void
+    BalanceLedger::build_unspent_tree()
+    {
+        m_heights.clear();
+
+        for (const merged_output& output: m_outputs)
+        {
+            m_heights.push_back(output.height);
+
+            if (output.spent_height != merged_output::UNSPENT_HEIGHT)
+            {
+                m_heights.push_back(output.spent_height);
+            }
+        }
+
+        sort(m_heights.begin(), m_heights.end());
+
+        m_heights.erase(unique(m_heights.begin(), m_heights.end()),
+                        m_heights.end());
+
+        size_t no_of_leaves = m_heights.size();
+
+        m_unspent_tree.assign(2 * no_of_leaves, vector<size_t>());
+
+        for (size_t i = 0; i < m_outputs.size(); ++i)
+        {
+            const merged_output& output = m_outputs[i];
+
+            size_t first = lower_bound(m_heights.begin(), m_heights.end(),
+                                       output.height) - m_heights.begin();
+
+            size_t last  = lower_bound(m_heights.begin(), m_heights.end(),
+                                       output.spent_height) - m_heights.begin();
+
+            for (first += no_of_leaves, last += no_of_leaves;
+                 first < last; first /= 2, last /= 2)
+            {
+                if (first % 2 == 1)
+                {
+                    m_unspent_tree[first++].push_back(i);
+                }
+
+                if (last % 2 == 1)
+                {
+                    m_unspent_tree[--last].push_back(i);
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,91 @@
+#ifndef XMREG01_BALANCELEDGER_H
+#define XMREG01_BALANCELEDGER_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "monero_headers.h"
+#include "ScanShard.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Our tx in the ledger, with the total
+     * balance after it.
+     */
+    struct ledger_tx
+    {
+        uint64_t     height;
+        uint64_t     tx_no;
+        crypto::hash tx_hash;
+        uint64_t     received;
+        uint64_t     spent;
+        uint64_t     balance;
+    };
+
+
+    /**
+     * History of our txs and outputs, sorted by height, made
+     * from merged shards or loaded from a ledger file.
+     *
+     * Balances after each tx are prefix sums of received
+     * minus spent, so the balance at any height is
+     * found with a binary search, without the blockchain.
+     *
+     * Each output is unspent over the heights
+     * [height, spent_height). These intervals are kept in
+     * a segment tree over the heights at which any output
+     * was received or spent, so outputs unspent at a height
+     * are found without checking all of them.
+     */
+    class BalanceLedger {
+
+        vector<ledger_tx>     m_txs;
+        vector<merged_output> m_outputs;
+
+        // sorted heights at which outputs were received or spent
+        vector<uint64_t>       m_heights;
+
+        // segment tree over m_heights, with positions of
+        // outputs in m_outputs unspent over each node's range
+        vector<vector<size_t>> m_unspent_tree;
+
+    public:
+        void
+        build(const vector<merged_tx>& txs,
+              const vector<merged_output>& outputs);
+
+        uint64_t
+        balance_at(uint64_t height) const;
+
+        void
+        outputs_unspent_at(uint64_t height,
+                           vector<merged_output>& outputs) const;
+
+        void
+        history(uint64_t start_height, uint64_t end_height,
+                vector<ledger_tx>& txs) const;
+
+        uint64_t
+        size() const;
+
+        bool
+        save(const string& file_path) const;
+
+        bool
+        load(const string& file_path);
+
+    private:
+        void
+        build_unspent_tree();
+    };
+
+}
+
+
+#endif //XMREG01_BALANCELEDGER_H
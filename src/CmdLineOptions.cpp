@@ -22,7 +22,67 @@ namespace xmreg
                 ("help,h", value<bool>()->default_value(false)->implicit_value(true),
                  "produce help message")
                 ("bc-path,b", value<string>(),
-                 "path to lmdb blockchain");
+                 "path to lmdb blockchain")
+                ("direct-db", value<bool>()->default_value(false)->implicit_value(true),
+                 "open only the lmdb database, without initializing "
+                 "cryptonote::Blockchain. Faster startup")
+                ("viewkey,v", value<string>(),
+                 "private view key string")
+                ("spendkey,s", value<string>(),
+                 "private spend key string")
+                ("address,a", value<string>(),
+                 "monero address string, checked against the given keys")
+                ("view-only", value<bool>()->default_value(false)->implicit_value(true),
+                 "find only incoming outputs using the view key. Key images "
+                 "are generated in background threads, if spend key is given")
+                ("key-images-file", value<string>(),
+                 "file with key images of outputs for the view-only mode. "
+                 "Each line has output public key and its key image")
+                ("start-height", value<uint64_t>()->default_value(0),
+                 "skip transactions in blocks below this height")
+                ("end-height", value<uint64_t>(),
+                 "with --shard-out or --build-index, use blocks up to, but not "
+                 "including, this height. Default is the current blockchain height")
+                ("shard-out", value<string>(),
+                 "scan blocks from --start-height to --end-height and write "
+                 "the results into this shard file")
+                ("merge-shards", value<vector<string>>()->multitoken(),
+                 "merge the given shard files and print our txs and balances")
+                ("ledger-file", value<string>(),
+                 "with --merge-shards, save our txs and outputs into this "
+                 "ledger file. Without it, print them from the ledger file")
+                ("balance-at", value<uint64_t>(),
+                 "with --merge-shards or --ledger-file, print balance and "
+                 "unspent outputs at this height")
+                ("build-index", value<string>(),
+                 "write public keys, outputs and key images of all txs "
+                 "from --start-height to --end-height into this index file")
+                ("index-file", value<string>(),
+                 "scan txs in this index file, instead of the blockchain")
+                ("prefetch-blocks", value<uint64_t>()->default_value(0),
+                 "with --shard-out or --build-index, read this many blocks "
+                 "and their txs ahead of the scanned block in a background "
+                 "thread. 0 is off")
+                ("memory-budget-mb", value<uint64_t>()->default_value(0),
+                 "limit memory used by ring member cache, shard outputs "
+                 "and lmdb pages during a scan to about this many MB. "
+                 "0 is off")
+                ("threads,t", value<uint64_t>()->default_value(1),
+                 "number of threads to use")
+                ("output-format,f", value<string>()->default_value("text"),
+                 "output format: text or csv")
+                ("tx-hashes-file", value<string>(),
+                 "file with tx hashes to check, one per line")
+                ("check-balances", value<string>(),
+                 "file with expected total balance after each tx, one per line. "
+                 "Program fails if the balances differ")
+                ("payment-ids-file", value<vector<string>>()->multitoken(),
+                 "save our outputs grouped by payment ids into this file. "
+                 "With --find-payment-id, several files can be given")
+                ("find-payment-id", value<string>(),
+                 "print our outputs with this payment id, "
+                 "using --payment-ids-file. 16 hex chars are "
+                 "an encrypted id, 64 a plain one");
 
 
         store(command_line_parser(acc, avv)
@@ -63,4 +123,10 @@ namespace xmreg
     template  boost::optional<bool>
     CmdLineOptions::get_option<bool>(const string & opt_name) const;
 
+    template  boost::optional<uint64_t>
+    CmdLineOptions::get_option<uint64_t>(const string & opt_name) const;
+
+    template  boost::optional<vector<string>>
+    CmdLineOptions::get_option<vector<string>>(const string & opt_name) const;
+
 }
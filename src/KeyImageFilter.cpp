@@ -0,0 +1,120 @@
+#include "KeyImageFilter.h"
+
+#include <cstring>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace xmreg
+{
+
+    const size_t KeyImageFilter::WORDS_IN_BLOCK;
+    const size_t KeyImageFilter::BLOCK_SIZE;
+
+
+    KeyImageFilter::KeyImageFilter(uint64_t expected_no_of_key_images,
+                                   uint64_t bits_per_key_image)
+    {
+        uint64_t no_of_bits = max<uint64_t>(expected_no_of_key_images, 1)
+                              * max<uint64_t>(bits_per_key_image, 1);
+
+        m_no_of_blocks = (no_of_bits + BLOCK_SIZE * 8 - 1) / (BLOCK_SIZE * 8);
+
+        m_storage.assign(m_no_of_blocks * WORDS_IN_BLOCK + WORDS_IN_BLOCK, 0);
+
+        // align the first block to BLOCK_SIZE
+        uintptr_t address = reinterpret_cast<uintptr_t>(m_storage.data());
+        uintptr_t aligned = (address + BLOCK_SIZE - 1) & ~uintptr_t(BLOCK_SIZE - 1);
+
+        m_blocks = reinterpret_cast<uint64_t*>(aligned);
+    }
+
+
+    /**
+     * Key images are points on the curve, so their bytes
+     * are already uniformly distributed. Thus, we don't hash them
+     * again, but take the block index from the first 8 bytes,
+     * and the bit positions from the next 8 bytes (6 bits per word).
+     */
+    uint64_t
+    KeyImageFilter::get_block_offset(const crypto::key_image& key_img,
+                              uint64_t masks[WORDS_IN_BLOCK]) const
+    {
+        uint64_t block_bits;
+        uint64_t bit_positions;
+
+        memcpy(&block_bits, &key_img, sizeof(uint64_t));
+        memcpy(&bit_positions,
+               reinterpret_cast<const char*>(&key_img) + sizeof(uint64_t),
+               sizeof(uint64_t));
+
+        for (size_t i = 0; i < WORDS_IN_BLOCK; ++i)
+        {
+            masks[i] = uint64_t(1) << ((bit_positions >> (6 * i)) & 63);
+        }
+
+        return (block_bits % m_no_of_blocks) * WORDS_IN_BLOCK;
+    }
+
+
+    void
+    KeyImageFilter::add(const crypto::key_image& key_img)
+    {
+        uint64_t masks[WORDS_IN_BLOCK];
+
+        uint64_t* block = m_blocks + get_block_offset(key_img, masks);
+
+        for (size_t i = 0; i < WORDS_IN_BLOCK; ++i)
+        {
+            block[i] |= masks[i];
+        }
+    }
+
+
+    /**
+     * Check if the key image may have been added.
+     *
+     * The words are checked all together, without
+     * early return. SSE2 is part of every x86-64 cpu, so
+     * there it is used explicitly, as the project is not
+     * built with optimizations that would vectorize the loop.
+     */
+    bool
+    KeyImageFilter::may_contain(const crypto::key_image& key_img) const
+    {
+        uint64_t masks[WORDS_IN_BLOCK];
+
+        const uint64_t* block = m_blocks + get_block_offset(key_img, masks);
+
+#ifdef __SSE2__
+        __m128i missing = _mm_setzero_si128();
+
+        // blocks are aligned to the cache line, masks are not
+        for (size_t i = 0; i < WORDS_IN_BLOCK; i += 2)
+        {
+            __m128i mask  = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(masks + i));
+            __m128i words = _mm_load_si128(
+                    reinterpret_cast<const __m128i*>(block + i));
+
+            // bits of the mask that are not set in the block
+            missing = _mm_or_si128(missing, _mm_andnot_si128(words, mask));
+        }
+
+        return _mm_movemask_epi8(
+                _mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#else
+        uint64_t missing {0};
+
+        for (size_t i = 0; i < WORDS_IN_BLOCK; ++i)
+        {
+            missing |= masks[i] & ~block[i];
+        }
+
+        return missing == 0;
+#endif
+    }
+
+}
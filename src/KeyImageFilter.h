@@ -0,0 +1,63 @@
+#ifndef XMREG01_KEYIMAGEFILTER_H
+#define XMREG01_KEYIMAGEFILTER_H
+
+#include <vector>
+#include <cstdint>
+
+#include "monero_headers.h"
+
+
+namespace xmreg
+{
+    using namespace std;
+
+    /**
+     * Blocked Bloom filter of key images.
+     *
+     * Each key image maps to one 64 byte block (one cache line)
+     * and sets one bit in each of its eight 64-bit words.
+     * So checking a key image touches a single cache line,
+     * and the eight words are checked without branches,
+     * two at a time with SSE2, where available.
+     *
+     * It can be shared by WalletScanners of many wallets,
+     * so that an input that is not ours (the most common case)
+     * is rejected with one check for all of them at once.
+     *
+     * There are no false negatives. False positives must
+     * be checked against the exact set of key images.
+     */
+    class KeyImageFilter {
+
+        static const size_t WORDS_IN_BLOCK = 8;
+        static const size_t BLOCK_SIZE     = WORDS_IN_BLOCK * sizeof(uint64_t);
+
+        // storage is over-allocated, so that
+        // m_blocks can be aligned to the cache line
+        vector<uint64_t> m_storage;
+        uint64_t*        m_blocks;
+        uint64_t         m_no_of_blocks;
+
+    public:
+        KeyImageFilter(uint64_t expected_no_of_key_images = 1 << 16,
+                       uint64_t bits_per_key_image = 16);
+
+        KeyImageFilter(const KeyImageFilter&) = delete;
+        KeyImageFilter& operator=(const KeyImageFilter&) = delete;
+
+        void
+        add(const crypto::key_image& key_img);
+
+        bool
+        may_contain(const crypto::key_image& key_img) const;
+
+    private:
+        uint64_t
+        get_block_offset(const crypto::key_image& key_img,
+                  uint64_t masks[WORDS_IN_BLOCK]) const;
+    };
+
+}
+
+
+#endif //XMREG01_KEYIMAGEFILTER_H
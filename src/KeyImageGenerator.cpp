@@ -0,0 +1,207 @@
+#include "KeyImageGenerator.h"
+
+#include <fstream>
+
+namespace xmreg
+{
+
+    KeyImageGenerator::KeyImageGenerator(uint64_t no_of_threads)
+    {
+        for (uint64_t i = 0; i < max<uint64_t>(no_of_threads, 1); ++i)
+        {
+            m_workers.emplace_back(&KeyImageGenerator::worker, this);
+        }
+    }
+
+
+    /**
+     * Set the private spend key used to generate key images
+     * of outputs that were not imported.
+     * Should be called before any submit().
+     */
+    void
+    KeyImageGenerator::set_private_spend_key(const crypto::secret_key& private_spend_key)
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        m_private_spend_key = private_spend_key;
+    }
+
+
+    /**
+     * Import key images from a text file. Each line
+     * has public key of an output and its key image, e.g.,
+     *
+     * <output public key> <key image>
+     */
+    bool
+    KeyImageGenerator::import_key_images(const string& file_path)
+    {
+        ifstream key_images_file(file_path);
+
+        if (!key_images_file.is_open())
+        {
+            cerr << "Cant open key images file: " << file_path << endl;
+            return false;
+        }
+
+        string out_pub_key_str;
+        string key_image_str;
+
+        lock_guard<mutex> lock(m_mutex);
+
+        while (key_images_file >> out_pub_key_str >> key_image_str)
+        {
+            crypto::public_key out_pub_key;
+            crypto::key_image  key_image;
+
+            if (!parse_str_secret_key(out_pub_key_str, out_pub_key)
+                || !parse_str_secret_key(key_image_str, key_image))
+            {
+                cerr << "Cant parse key images file: " << file_path << endl;
+                return false;
+            }
+
+            m_imported_key_images[out_pub_key] = key_image;
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Queue our output for getting its key image.
+     *
+     * Imported key images are used right away. Others
+     * are generated in the worker threads, if we have
+     * the private spend key. Otherwise, the key image of
+     * the output can't be known, and the output is dropped.
+     */
+    void
+    KeyImageGenerator::submit(const owned_output& output,
+                              const crypto::key_derivation& derivation)
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        auto it = m_imported_key_images.find(output.out_pub_key);
+
+        if (it != m_imported_key_images.end())
+        {
+            owned_output with_key_image = output;
+
+            with_key_image.key_image     = it->second;
+            with_key_image.has_key_image = true;
+
+            m_done.push_back(with_key_image);
+            return;
+        }
+
+        if (!m_private_spend_key)
+        {
+            return;
+        }
+
+        m_queue.push_back({output, derivation});
+
+        m_work_cv.notify_one();
+    }
+
+
+    /**
+     * Wait until all the submitted outputs are processed,
+     * and return the ones with key images determined since
+     * the last call.
+     */
+    bool
+    KeyImageGenerator::wait(vector<owned_output>& outputs)
+    {
+        unique_lock<mutex> lock(m_mutex);
+
+        m_done_cv.wait(lock, [this] {
+            return m_queue.empty() && m_in_progress == 0;
+        });
+
+        outputs.clear();
+        outputs.swap(m_done);
+
+        bool success = !m_failed;
+
+        m_failed = false;
+
+        return success;
+    }
+
+
+    void
+    KeyImageGenerator::worker()
+    {
+        unique_lock<mutex> lock(m_mutex);
+
+        while (true)
+        {
+            m_work_cv.wait(lock, [this] {
+                return m_stop || !m_queue.empty();
+            });
+
+            if (m_queue.empty())
+            {
+                // m_stop was set
+                return;
+            }
+
+            pending_output pending = m_queue.front();
+            m_queue.pop_front();
+
+            ++m_in_progress;
+
+            crypto::secret_key private_spend_key = *m_private_spend_key;
+
+            // generate the key image without holding the lock,
+            // as this is the expensive part
+            lock.unlock();
+
+            bool generated = generate_output_key_image(pending.derivation,
+                                                       pending.output.out_idx,
+                                                       private_spend_key,
+                                                       pending.output.out_pub_key,
+                                                       pending.output.key_image);
+            lock.lock();
+
+            --m_in_progress;
+
+            if (generated)
+            {
+                pending.output.has_key_image = true;
+                m_done.push_back(pending.output);
+            }
+            else
+            {
+                cerr << "Cant generate key image for tx: "
+                     << pending.output.tx_hash << endl;
+                m_failed = true;
+            }
+
+            if (m_queue.empty() && m_in_progress == 0)
+            {
+                m_done_cv.notify_all();
+            }
+        }
+    }
+
+
+    KeyImageGenerator::~KeyImageGenerator()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_work_cv.notify_all();
+
+        for (thread& worker_thread: m_workers)
+        {
+            worker_thread.join();
+        }
+    }
+
+}
@@ -0,0 +1,88 @@
+#ifndef XMREG01_KEYIMAGEGENERATOR_H
+#define XMREG01_KEYIMAGEGENERATOR_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+#include "monero_headers.h"
+#include "tools.h"
+#include "WalletScanner.h"
+
+
+namespace xmreg
+{
+    using namespace std;
+
+    /**
+     * Determines key images of outputs found by a view-only
+     * WalletScanner, in background threads.
+     *
+     * Key images are either taken from the imported ones
+     * (e.g., exported from a cold wallet), or generated using
+     * the private spend key, if it was given.
+     *
+     * Outputs are given with submit(). Then wait()
+     * returns them with their key images, once all the
+     * submitted outputs are processed.
+     */
+    class KeyImageGenerator {
+
+        struct pending_output
+        {
+            owned_output           output;
+            crypto::key_derivation derivation;
+        };
+
+        boost::optional<crypto::secret_key> m_private_spend_key;
+
+        // output public key -> its key image
+        unordered_map<crypto::public_key, crypto::key_image> m_imported_key_images;
+
+        mutex              m_mutex;
+        condition_variable m_work_cv;
+        condition_variable m_done_cv;
+
+        deque<pending_output> m_queue;
+        vector<owned_output>  m_done;
+
+        size_t m_in_progress {0};
+        bool   m_failed      {false};
+        bool   m_stop        {false};
+
+        vector<thread> m_workers;
+
+    public:
+        KeyImageGenerator(uint64_t no_of_threads = 1);
+
+        KeyImageGenerator(const KeyImageGenerator&) = delete;
+        KeyImageGenerator& operator=(const KeyImageGenerator&) = delete;
+
+        void
+        set_private_spend_key(const crypto::secret_key& private_spend_key);
+
+        bool
+        import_key_images(const string& file_path);
+
+        void
+        submit(const owned_output& output,
+               const crypto::key_derivation& derivation);
+
+        bool
+        wait(vector<owned_output>& outputs);
+
+        virtual ~KeyImageGenerator();
+
+    private:
+        void
+        worker();
+    };
+
+}
+
+
+#endif //XMREG01_KEYIMAGEGENERATOR_H
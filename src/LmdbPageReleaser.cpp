@@ -0,0 +1,129 @@
+#include "LmdbPageReleaser.h"
+#include "tools.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+namespace xmreg
+{
+
+    namespace
+    {
+        // RSS is read from /proc every this many calls of check()
+        const uint64_t CHECK_INTERVAL = 64;
+    }
+
+
+    LmdbPageReleaser::LmdbPageReleaser(uint64_t memory_budget):
+            m_budget_kb(memory_budget / 1024)
+    {}
+
+
+    /**
+     * Find where lmdb mapped data.mdb in this process, so
+     * the database must already be open. The map is found
+     * in /proc/self/maps by the device and inode of the file,
+     * as a path alone can be given in many ways.
+     */
+    bool
+    LmdbPageReleaser::open(const string& blockchain_path)
+    {
+        string data_file_path = blockchain_path + "/data.mdb";
+
+        struct stat file_stat;
+
+        if (stat(data_file_path.c_str(), &file_stat) != 0)
+        {
+            cerr << "Cant stat lmdb data file: " << data_file_path << endl;
+            return false;
+        }
+
+        ifstream maps_file("/proc/self/maps");
+
+        string line;
+
+        while (getline(maps_file, line))
+        {
+            // e.g. 7f2a4c000000-7f3a4c000000 r--s 00000000 08:01 1234 /path/data.mdb
+            istringstream line_stream(line);
+
+            string   addresses, perms, offset;
+            uint64_t dev_major, dev_minor, inode;
+            char     colon;
+
+            if (!(line_stream >> addresses >> perms >> offset
+                              >> hex >> dev_major >> colon >> dev_minor
+                              >> dec >> inode))
+            {
+                continue;
+            }
+
+            if (inode != static_cast<uint64_t>(file_stat.st_ino)
+                || dev_major != major(file_stat.st_dev)
+                || dev_minor != minor(file_stat.st_dev))
+            {
+                continue;
+            }
+
+            size_t dash_pos = addresses.find('-');
+
+            if (dash_pos == string::npos)
+            {
+                continue;
+            }
+
+            uint64_t start_addr = stoull(addresses.substr(0, dash_pos), nullptr, 16);
+            uint64_t end_addr   = stoull(addresses.substr(dash_pos + 1), nullptr, 16);
+
+            m_map_addr = reinterpret_cast<char*>(start_addr);
+            m_map_size = end_addr - start_addr;
+
+            return true;
+        }
+
+        cerr << "Cant find lmdb map of " << data_file_path
+             << " in /proc/self/maps, its pages will not be released" << endl;
+
+        return false;
+    }
+
+
+    /**
+     * Called for each scanned block or tx. Drops the lmdb
+     * map if the RSS is over the budget.
+     */
+    void
+    LmdbPageReleaser::check()
+    {
+        if (!m_map_addr || m_budget_kb == 0
+            || ++m_no_of_calls % CHECK_INTERVAL != 0)
+        {
+            return;
+        }
+
+        if (get_current_rss_kb() <= m_budget_kb)
+        {
+            return;
+        }
+
+        if (madvise(m_map_addr, m_map_size, MADV_DONTNEED) == 0)
+        {
+            ++m_no_of_releases;
+        }
+    }
+
+
+    /**
+     * How many times the lmdb map was dropped
+     */
+    uint64_t
+    LmdbPageReleaser::no_of_releases() const
+    {
+        return m_no_of_releases;
+    }
+
+}
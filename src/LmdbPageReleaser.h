@@ -0,0 +1,58 @@
+#ifndef XMREG01_LMDBPAGERELEASER_H
+#define XMREG01_LMDBPAGERELEASER_H
+
+#include <iostream>
+#include <string>
+
+
+namespace xmreg
+{
+    using namespace std;
+
+    /**
+     * Keeps lmdb pages mapped by this process within
+     * the memory budget during long scans.
+     *
+     * lmdb maps the whole data.mdb, and every page read
+     * by a scan stays in this process' RSS. The order of
+     * pages in the file does not follow block heights, as
+     * txs and outputs are in trees keyed by hashes and
+     * indices, so there is no part of the map that is
+     * known to be behind the scan.
+     *
+     * Instead, the RSS is checked every few blocks, and
+     * whenever it is over the budget, the whole lmdb map
+     * is dropped with madvise(MADV_DONTNEED). The map is
+     * read-only and backed by the file, so this only
+     * removes the pages from this process. lmdb reads them
+     * again from the page cache, or the disk, when needed.
+     * The page cache itself, shared with other processes,
+     * is not touched.
+     */
+    class LmdbPageReleaser {
+
+        uint64_t m_budget_kb      {0};
+        uint64_t m_no_of_calls    {0};
+        uint64_t m_no_of_releases {0};
+
+        // lmdb map of data.mdb in this process, if found
+        char*    m_map_addr       {nullptr};
+        uint64_t m_map_size       {0};
+
+    public:
+        LmdbPageReleaser(uint64_t memory_budget);
+
+        bool
+        open(const string& blockchain_path);
+
+        void
+        check();
+
+        uint64_t
+        no_of_releases() const;
+    };
+
+}
+
+
+#endif //XMREG01_LMDBPAGERELEASER_H
@@ -0,0 +1,131 @@
+#include "LmdbPrefetcher.h"
+
+#include <algorithm>
+
+namespace xmreg
+{
+
+    LmdbPrefetcher::LmdbPrefetcher(BlockchainDB& db, uint64_t no_of_blocks_ahead):
+            m_db(db),
+            m_no_of_blocks_ahead(max<uint64_t>(no_of_blocks_ahead, 1))
+    {}
+
+
+    /**
+     * Start reading ahead of blocks in [start_height, end_height)
+     */
+    void
+    LmdbPrefetcher::start(uint64_t start_height, uint64_t end_height)
+    {
+        finish();
+
+        m_scanned_height = start_height;
+        m_prefetched_to  = start_height;
+        m_end_height     = end_height;
+        m_stop           = false;
+
+        m_reader = thread(&LmdbPrefetcher::reader, this);
+    }
+
+
+    /**
+     * Called for each scanned height, so that
+     * the reader stays just ahead of the scan.
+     */
+    void
+    LmdbPrefetcher::advance(uint64_t height)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_scanned_height = height;
+        }
+
+        m_cv.notify_one();
+    }
+
+
+    /**
+     * Stop the reader thread
+     */
+    void
+    LmdbPrefetcher::finish()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_cv.notify_one();
+
+        if (m_reader.joinable())
+        {
+            m_reader.join();
+        }
+    }
+
+
+    LmdbPrefetcher::~LmdbPrefetcher()
+    {
+        finish();
+    }
+
+
+    /**
+     * Reads blocks after the scanned height, and their txs.
+     * Read blocks are just dropped. Only their pages
+     * being in memory matters for the scan.
+     *
+     * Errors are ignored, as the scan reads the same
+     * blocks again, and reports them.
+     */
+    void
+    LmdbPrefetcher::reader()
+    {
+        unique_lock<mutex> lock(m_mutex);
+
+        while (true)
+        {
+            m_cv.wait(lock, [this]()
+            {
+                return m_stop
+                       || (m_prefetched_to < m_end_height
+                           && m_prefetched_to <= m_scanned_height
+                                                 + m_no_of_blocks_ahead);
+            });
+
+            if (m_stop)
+            {
+                return;
+            }
+
+            // no point reading what was already scanned
+            uint64_t height = max(m_prefetched_to, m_scanned_height + 1);
+
+            m_prefetched_to = height + 1;
+
+            if (height >= m_end_height)
+            {
+                continue;
+            }
+
+            lock.unlock();
+
+            try
+            {
+                block blk = m_db.get_block_from_height(height);
+
+                for (const crypto::hash& tx_hash: blk.tx_hashes)
+                {
+                    m_db.get_tx(tx_hash);
+                }
+            }
+            catch (const std::exception&)
+            {
+                // the scan will fail on this block too
+            }
+
+            lock.lock();
+        }
+    }
+
+}
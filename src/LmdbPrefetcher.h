@@ -0,0 +1,78 @@
+#ifndef XMREG01_LMDBPREFETCHER_H
+#define XMREG01_LMDBPREFETCHER_H
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "monero_headers.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Read-ahead of blocks and txs for scans over
+     * consecutive block heights.
+     *
+     * Blocks are keyed by height, but txs are keyed by
+     * their hashes, so where they are in data.mdb can't be
+     * guessed from the height. Instead, a reader thread
+     * reads blocks h + 1 to h + no_of_blocks_ahead, and
+     * their txs, while the scan is at height h. Each read
+     * is in its own lmdb read txn, as in the scan.
+     *
+     * The scan then finds the pages of these blocks and
+     * txs already in memory, which turns most of random
+     * disk reads of a cold scan into ones done in the
+     * background. This matters mostly for spinning and
+     * network disks.
+     *
+     * Nothing is evicted from the page cache, as it is
+     * shared with other processes, e.g., other shard scans.
+     */
+    class LmdbPrefetcher {
+
+        BlockchainDB& m_db;
+        uint64_t      m_no_of_blocks_ahead;
+
+        mutex              m_mutex;
+        condition_variable m_cv;
+
+        uint64_t m_scanned_height {0};
+        uint64_t m_prefetched_to  {0};
+        uint64_t m_end_height     {0};
+        bool     m_stop           {false};
+
+        thread   m_reader;
+
+    public:
+        LmdbPrefetcher(BlockchainDB& db, uint64_t no_of_blocks_ahead);
+
+        LmdbPrefetcher(const LmdbPrefetcher&) = delete;
+        LmdbPrefetcher& operator=(const LmdbPrefetcher&) = delete;
+
+        void
+        start(uint64_t start_height, uint64_t end_height);
+
+        void
+        advance(uint64_t height);
+
+        void
+        finish();
+
+        virtual ~LmdbPrefetcher();
+
+    private:
+        void
+        reader();
+    };
+
+}
+
+
+#endif //XMREG01_LMDBPREFETCHER_H
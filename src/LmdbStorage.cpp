@@ -0,0 +1,70 @@
+#include "LmdbStorage.h"
+
+namespace xmreg
+{
+
+    LmdbStorage::LmdbStorage(): m_db(new BlockchainLMDB())
+    {}
+
+
+    /**
+     * Open database files located in blockchain_path.
+     *
+     * Only reading is done here, so the database is opened
+     * read-only. This way many scanning processes, e.g.,
+     * one per shard, can share it with a running monerod.
+     */
+    bool
+    LmdbStorage::init(const string& blockchain_path)
+    {
+        int db_flags = 0;
+
+        db_flags |= MDB_RDONLY;
+
+        try
+        {
+            // try opening lmdb database files
+            m_db->open(blockchain_path, db_flags);
+        }
+        catch (const std::exception& e)
+        {
+            cerr << "Error opening database: " << e.what() << endl;
+            return false;
+        }
+
+        return m_db->is_open();
+    }
+
+
+    BlockchainDB&
+    LmdbStorage::get_db()
+    {
+        return *m_db;
+    }
+
+
+    /**
+     * Close the database, if it was opened.
+     *
+     * close() syncs the database first, which fails on
+     * a read-only one and throws. Nothing was written,
+     * so the error is ignored, as Blockchain::deinit() does.
+     */
+    LmdbStorage::~LmdbStorage()
+    {
+        if (!m_db->is_open())
+        {
+            return;
+        }
+
+        try
+        {
+            m_db->close();
+        }
+        catch (const std::exception&)
+        {
+            // nothing to do, the database was opened read-only
+        }
+    }
+
+}
@@ -0,0 +1,43 @@
+#ifndef XMREG01_LMDBSTORAGE_H
+#define XMREG01_LMDBSTORAGE_H
+
+#include <iostream>
+#include <memory>
+
+#include "monero_headers.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Read access to the lmdb blockchain database,
+     * without MicroCore.
+     *
+     * MicroCore creates cryptonote::Blockchain and
+     * tx_memory_pool, and initializes them, which takes
+     * time and memory. This is not needed if we only read blocks
+     * and txs, so here only BlockchainLMDB is opened.
+     */
+    class LmdbStorage {
+
+        unique_ptr<BlockchainLMDB> m_db;
+
+    public:
+        LmdbStorage();
+
+        bool
+        init(const string& blockchain_path);
+
+        BlockchainDB&
+        get_db();
+
+        virtual ~LmdbStorage();
+    };
+
+}
+
+
+#endif //XMREG01_LMDBSTORAGE_H
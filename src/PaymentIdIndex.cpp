@@ -0,0 +1,221 @@
+#include "PaymentIdIndex.h"
+#include "tools.h"
+
+#include <algorithm>
+
+namespace xmreg
+{
+
+    namespace
+    {
+        // first bytes of every payment id index file
+        const char PAYMENT_ID_MAGIC[8] = {'X', 'M', 'R', 'P', 'I', 'D', 'X', '2'};
+    }
+
+
+    /**
+     * Add our outputs of a scanned tx,
+     * if the tx has a payment id.
+     */
+    void
+    PaymentIdIndex::add(const tx_scan_result& result)
+    {
+        if (!result.has_payment_id || result.outputs.empty())
+        {
+            return;
+        }
+
+        vector<owned_output>& outputs
+                = get_payments(result.payment_id_encrypted)[result.payment_id];
+
+        outputs.insert(outputs.end(),
+                       result.outputs.begin(),
+                       result.outputs.end());
+
+        m_no_of_outputs += result.outputs.size();
+    }
+
+
+    /**
+     * Get our outputs with the given plain or encrypted
+     * payment id, or nullptr if there are none.
+     */
+    const vector<owned_output>*
+    PaymentIdIndex::find(const crypto::hash& payment_id, bool encrypted) const
+    {
+        const auto& payments = get_payments(encrypted);
+
+        auto it = payments.find(payment_id);
+
+        if (it == payments.end())
+        {
+            return nullptr;
+        }
+
+        return &it->second;
+    }
+
+
+    uint64_t
+    PaymentIdIndex::size() const
+    {
+        return m_payments.size() + m_encrypted_payments.size();
+    }
+
+
+    uint64_t
+    PaymentIdIndex::no_of_outputs() const
+    {
+        return m_no_of_outputs;
+    }
+
+
+    /**
+     * The file has the magic, number of payment ids,
+     * and then, for each payment id, whether it is encrypted,
+     * the number of its outputs followed by the outputs.
+     */
+    bool
+    PaymentIdIndex::save(const string& file_path) const
+    {
+        ofstream file(file_path, ios::binary | ios::trunc);
+
+        if (!file.is_open())
+        {
+            cerr << "Cant open payment id index for writing: "
+                 << file_path << endl;
+            return false;
+        }
+
+        file.write(PAYMENT_ID_MAGIC, sizeof(PAYMENT_ID_MAGIC));
+
+        write_pod(file, static_cast<uint64_t>(size()));
+
+        for (bool encrypted: {false, true})
+        {
+            for (const auto& payment: get_payments(encrypted))
+            {
+                write_pod(file, static_cast<uint8_t>(encrypted));
+                write_pod(file, payment.first);
+                write_pod(file, static_cast<uint64_t>(payment.second.size()));
+
+                for (const owned_output& output: payment.second)
+                {
+                    // in the view-only mode, key image is not set, so
+                    // zeros are written instead of whatever is in memory
+                    crypto::key_image key_image = output.has_key_image
+                                                  ? output.key_image
+                                                  : crypto::key_image {};
+
+                    write_pod(file, output.tx_hash);
+                    write_pod(file, output.out_idx);
+                    write_pod(file, output.out_pub_key);
+                    write_pod(file, output.amount);
+                    write_pod(file, key_image);
+                    write_pod(file, static_cast<uint8_t>(output.has_key_image));
+                }
+            }
+        }
+
+        file.close();
+
+        if (file.fail())
+        {
+            cerr << "Error writing payment id index: " << file_path << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Load the index saved with save(). Payment ids
+     * already in the index are kept.
+     */
+    bool
+    PaymentIdIndex::load(const string& file_path)
+    {
+        ifstream file(file_path, ios::binary);
+
+        if (!file.is_open())
+        {
+            cerr << "Cant open payment id index: " << file_path << endl;
+            return false;
+        }
+
+        char magic[sizeof(PAYMENT_ID_MAGIC)];
+
+        if (!file.read(magic, sizeof(magic))
+            || !equal(begin(magic), end(magic), begin(PAYMENT_ID_MAGIC)))
+        {
+            cerr << "Not a payment id index: " << file_path << endl;
+            return false;
+        }
+
+        uint64_t no_of_payment_ids;
+
+        if (!read_pod(file, no_of_payment_ids))
+        {
+            cerr << "Cant read payment id index: " << file_path << endl;
+            return false;
+        }
+
+        for (uint64_t i = 0; i < no_of_payment_ids; ++i)
+        {
+            uint8_t      encrypted;
+            crypto::hash payment_id;
+            uint64_t     no_of_outputs;
+
+            if (!(read_pod(file, encrypted)
+                  && read_pod(file, payment_id)
+                  && read_pod(file, no_of_outputs)))
+            {
+                cerr << "Cant read payment id index: " << file_path << endl;
+                return false;
+            }
+
+            vector<owned_output>& outputs = get_payments(encrypted != 0)[payment_id];
+
+            for (uint64_t j = 0; j < no_of_outputs; ++j)
+            {
+                owned_output output;
+                uint8_t      has_key_image;
+
+                if (!(read_pod(file, output.tx_hash)
+                      && read_pod(file, output.out_idx)
+                      && read_pod(file, output.out_pub_key)
+                      && read_pod(file, output.amount)
+                      && read_pod(file, output.key_image)
+                      && read_pod(file, has_key_image)))
+                {
+                    cerr << "Cant read payment id index: " << file_path << endl;
+                    return false;
+                }
+
+                output.has_key_image = has_key_image != 0;
+
+                outputs.push_back(output);
+            }
+
+            m_no_of_outputs += no_of_outputs;
+        }
+
+        return true;
+    }
+
+
+    unordered_map<crypto::hash, vector<owned_output>>&
+    PaymentIdIndex::get_payments(bool encrypted)
+    {
+        return encrypted ? m_encrypted_payments : m_payments;
+    }
+
+
+    const unordered_map<crypto::hash, vector<owned_output>>&
+    PaymentIdIndex::get_payments(bool encrypted) const
+    {
+        return encrypted ? m_encrypted_payments : m_payments;
+    }
+
+}
@@ -0,0 +1,67 @@
+#ifndef XMREG01_PAYMENTIDINDEX_H
+#define XMREG01_PAYMENTIDINDEX_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+
+#include "monero_headers.h"
+#include "WalletScanner.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Our outputs grouped by payment ids of their txs.
+     *
+     * Used, e.g., by exchanges, where each deposit has
+     * a payment id of a user. Looking up deposits for
+     * a payment id is a single hash table lookup.
+     *
+     * Encrypted (8 byte) payment ids are kept decrypted
+     * and padded with zeros to 32 bytes. They are kept
+     * apart from plain ones, as a padded id can also be
+     * a valid plain id of someone else.
+     */
+    class PaymentIdIndex {
+
+        unordered_map<crypto::hash, vector<owned_output>> m_payments;
+        unordered_map<crypto::hash, vector<owned_output>> m_encrypted_payments;
+
+        uint64_t m_no_of_outputs {0};
+
+    public:
+        void
+        add(const tx_scan_result& result);
+
+        const vector<owned_output>*
+        find(const crypto::hash& payment_id, bool encrypted) const;
+
+        uint64_t
+        size() const;
+
+        uint64_t
+        no_of_outputs() const;
+
+        bool
+        save(const string& file_path) const;
+
+        bool
+        load(const string& file_path);
+
+    private:
+        unordered_map<crypto::hash, vector<owned_output>>&
+        get_payments(bool encrypted);
+
+        const unordered_map<crypto::hash, vector<owned_output>>&
+        get_payments(bool encrypted) const;
+    };
+
+}
+
+
+#endif //XMREG01_PAYMENTIDINDEX_H
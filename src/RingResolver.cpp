@@ -0,0 +1,145 @@
+#include "RingResolver.h"
+
+#include <algorithm>
+
+namespace xmreg
+{
+
+    RingResolver::RingResolver(BlockchainDB& db, uint64_t max_cache_size):
+            m_db(db)
+    {
+        // approximate size of a cached lookup, i.e., hash
+        // table node with the global index and tx_out_index,
+        // and its bucket pointer
+        const uint64_t CACHE_ENTRY_SIZE = sizeof(pair<const uint64_t, tx_out_index>)
+                                          + 2 * sizeof(void*);
+
+        if (max_cache_size > 0)
+        {
+            m_max_cached = max<uint64_t>(max_cache_size / CACHE_ENTRY_SIZE, 1);
+        }
+    }
+
+
+    /**
+     * key_offsets in an input are stored relative to each other,
+     * i.e., first one is a global index, and each next one
+     * is a difference to the previous one. Here we convert
+     * them into absolute global output indices.
+     */
+    bool
+    RingResolver::get_absolute_offsets(const txin_to_key& tx_in_to_key,
+                                       vector<uint64_t>& absolute_offsets) const
+    {
+        if (tx_in_to_key.key_offsets.empty())
+        {
+            cerr << "Input has no key offsets, key image: "
+                 << tx_in_to_key.k_image << endl;
+            return false;
+        }
+
+        absolute_offsets = relative_output_offsets_to_absolute(
+                tx_in_to_key.key_offsets);
+
+        return true;
+    }
+
+
+    /**
+     * Get (tx hash, output index) of each ring member
+     * of the given input. ring_members is in the same order
+     * as key_offsets of the input.
+     *
+     * Offsets not yet in the cache are collected first,
+     * and then read from the database in one pass in
+     * the ascending order of their global indices, which keeps
+     * lmdb cursor access local for large rings.
+     */
+    bool
+    RingResolver::resolve(const txin_to_key& tx_in_to_key,
+                          vector<tx_out_index>& ring_members)
+    {
+        vector<uint64_t> absolute_offsets;
+
+        if (!get_absolute_offsets(tx_in_to_key, absolute_offsets))
+        {
+            return false;
+        }
+
+        // start over, rather than track which lookups are least
+        // used, as popular outputs get back into the cache soon
+        if (m_max_cached > 0
+            && m_no_of_cached + absolute_offsets.size() > m_max_cached)
+        {
+            clear_cache();
+        }
+
+        unordered_map<uint64_t, tx_out_index>& amount_cache
+                = m_cache[tx_in_to_key.amount];
+
+        // absolute offsets are already in ascending order,
+        // so the missing ones will be as well
+        vector<uint64_t> missing_offsets;
+
+        for (const uint64_t& offset: absolute_offsets)
+        {
+            if (amount_cache.count(offset) == 0)
+            {
+                missing_offsets.push_back(offset);
+            }
+        }
+
+        m_cache_hits   += absolute_offsets.size() - missing_offsets.size();
+        m_cache_misses += missing_offsets.size();
+
+        m_no_of_cached += missing_offsets.size();
+
+        try
+        {
+            for (const uint64_t& offset: missing_offsets)
+            {
+                amount_cache[offset] = m_db.get_output_tx_and_index(
+                        tx_in_to_key.amount, offset);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            cerr << "Cant resolve ring members of key image "
+                 << tx_in_to_key.k_image << ": " << e.what() << endl;
+            return false;
+        }
+
+        ring_members.clear();
+        ring_members.reserve(absolute_offsets.size());
+
+        for (const uint64_t& offset: absolute_offsets)
+        {
+            ring_members.push_back(amount_cache[offset]);
+        }
+
+        return true;
+    }
+
+
+    void
+    RingResolver::clear_cache()
+    {
+        m_cache.clear();
+        m_no_of_cached = 0;
+    }
+
+
+    uint64_t
+    RingResolver::cache_hits() const
+    {
+        return m_cache_hits;
+    }
+
+
+    uint64_t
+    RingResolver::cache_misses() const
+    {
+        return m_cache_misses;
+    }
+
+}
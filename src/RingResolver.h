@@ -0,0 +1,67 @@
+#ifndef XMREG01_RINGRESOLVER_H
+#define XMREG01_RINGRESOLVER_H
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+
+#include "monero_headers.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Resolves ring members of a txin_to_key input, i.e.,
+     * its relative key_offsets, into global output indices
+     * and then into (tx hash, output index in that tx) pairs.
+     *
+     * Lookups already made are kept in a per-amount cache,
+     * so that outputs referenced by many rings (which is
+     * common for popular denominations) are read from
+     * the database only once.
+     *
+     * If max_cache_size (in bytes) is given, the cache is
+     * cleared when it would grow above it.
+     */
+    class RingResolver {
+
+        BlockchainDB& m_db;
+
+        // amount -> (global output index -> tx_out_index)
+        unordered_map<uint64_t,
+                unordered_map<uint64_t, tx_out_index>> m_cache;
+
+        uint64_t m_max_cached   {0};
+        uint64_t m_no_of_cached {0};
+
+        uint64_t m_cache_hits   {0};
+        uint64_t m_cache_misses {0};
+
+    public:
+        RingResolver(BlockchainDB& db, uint64_t max_cache_size = 0);
+
+        bool
+        get_absolute_offsets(const txin_to_key& tx_in_to_key,
+                             vector<uint64_t>& absolute_offsets) const;
+
+        bool
+        resolve(const txin_to_key& tx_in_to_key,
+                vector<tx_out_index>& ring_members);
+
+        void
+        clear_cache();
+
+        uint64_t
+        cache_hits() const;
+
+        uint64_t
+        cache_misses() const;
+    };
+
+}
+
+
+#endif //XMREG01_RINGRESOLVER_H
@@ -0,0 +1,700 @@
+#include "ScanShard.h"
+#include "tools.h"
+
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace xmreg
+{
+
+    namespace
+    {
+        // first bytes of every shard file
+        const char SHARD_MAGIC[8] = {'X', 'M', 'R', 'S', 'H', 'R', 'D', '2'};
+
+        // sizes of records, as written by write_pod
+        const uint64_t INPUT_SIZE  = sizeof(crypto::key_image) + sizeof(uint64_t);
+
+        const uint64_t OUTPUT_SIZE = 4 * sizeof(uint64_t)
+                                     + sizeof(crypto::hash)
+                                     + sizeof(crypto::key_image);
+
+        const uint64_t HEADER_SIZE = sizeof(SHARD_MAGIC)
+                                     + sizeof(crypto::hash)
+                                     + 7 * sizeof(uint64_t);
+
+        crypto::hash
+        get_wallet_hash(const account_public_address& address)
+        {
+            char data[2 * sizeof(crypto::public_key)];
+
+            memcpy(data, &address.m_spend_public_key, sizeof(crypto::public_key));
+            memcpy(data + sizeof(crypto::public_key),
+                   &address.m_view_public_key, sizeof(crypto::public_key));
+
+            crypto::hash wallet_hash;
+
+            crypto::cn_fast_hash(data, sizeof(data), wallet_hash);
+
+            return wallet_hash;
+        }
+
+        void
+        write_output(ostream& os, const shard_output& output)
+        {
+            write_pod(os, output.height);
+            write_pod(os, output.tx_no);
+            write_pod(os, output.tx_hash);
+            write_pod(os, output.out_idx);
+            write_pod(os, output.amount);
+            write_pod(os, output.key_image);
+        }
+
+        void
+        write_header_fields(ostream& os, const shard_header& header)
+        {
+            os.write(SHARD_MAGIC, sizeof(SHARD_MAGIC));
+
+            write_pod(os, header.wallet_hash);
+            write_pod(os, header.start_height);
+            write_pod(os, header.end_height);
+            write_pod(os, header.no_of_input_txs);
+            write_pod(os, header.no_of_outputs);
+            write_pod(os, header.outputs_offset);
+            write_pod(os, header.received);
+            write_pod(os, header.spent);
+        }
+
+        bool
+        read_header_fields(istream& is, shard_header& header)
+        {
+            char magic[sizeof(SHARD_MAGIC)];
+
+            if (!is.read(magic, sizeof(magic))
+                || !equal(begin(magic), end(magic), begin(SHARD_MAGIC)))
+            {
+                return false;
+            }
+
+            return read_pod(is, header.wallet_hash)
+                   && read_pod(is, header.start_height)
+                   && read_pod(is, header.end_height)
+                   && read_pod(is, header.no_of_input_txs)
+                   && read_pod(is, header.no_of_outputs)
+                   && read_pod(is, header.outputs_offset)
+                   && read_pod(is, header.received)
+                   && read_pod(is, header.spent);
+        }
+    }
+
+
+    const uint64_t merged_output::UNSPENT_HEIGHT
+            = numeric_limits<uint64_t>::max();
+
+
+    /**
+     * Output is unspent at a height if it was received
+     * at or before it, and spent only after it.
+     */
+    bool
+    merged_output::is_unspent_at(uint64_t at_height) const
+    {
+        return height <= at_height && spent_height > at_height;
+    }
+
+
+    ScanShardWriter::ScanShardWriter(const string& file_path,
+                                     const account_public_address& address,
+                                     uint64_t start_height,
+                                     uint64_t end_height):
+            m_file_path(file_path),
+            m_tmp_file_path(file_path + ".tmp")
+    {
+        m_file.open(m_tmp_file_path, ios::binary | ios::trunc);
+
+        if (!m_file.is_open())
+        {
+            cerr << "Cant open shard file for writing: " << m_tmp_file_path << endl;
+            return;
+        }
+
+        m_header.wallet_hash  = get_wallet_hash(address);
+        m_header.start_height = start_height;
+        m_header.end_height   = end_height;
+
+        // placeholder, until counts are known
+        write_header();
+    }
+
+
+    /**
+     * If not closed, the scan did not finish, so
+     * remove the unfinished shard and spilled outputs.
+     */
+    ScanShardWriter::~ScanShardWriter()
+    {
+        if (m_spill_file.is_open())
+        {
+            m_spill_file.close();
+            remove(m_spill_file_path.c_str());
+        }
+
+        if (m_file.is_open())
+        {
+            m_file.close();
+            remove(m_tmp_file_path.c_str());
+        }
+    }
+
+
+    bool
+    ScanShardWriter::is_open() const
+    {
+        return m_file.is_open();
+    }
+
+
+    /**
+     * Limit memory (in bytes) used by our outputs
+     * kept until closing. 0 means no limit.
+     */
+    void
+    ScanShardWriter::set_memory_budget(uint64_t budget)
+    {
+        m_max_outputs = budget > 0
+                        ? max<uint64_t>(budget / sizeof(shard_output), 1)
+                        : 0;
+    }
+
+
+    /**
+     * Add a scanned tx. Inputs of all txs are written, as
+     * they can spend our outputs from earlier shards. Our outputs
+     * are kept in memory and written when closing.
+     */
+    void
+    ScanShardWriter::add_tx(uint64_t height, uint64_t tx_no,
+                            const transaction& tx,
+                            const tx_scan_result& result)
+    {
+        for (const owned_output& output: result.outputs)
+        {
+            m_outputs.push_back({height, tx_no, output.tx_hash,
+                                 output.out_idx, output.amount,
+                                 output.key_image});
+        }
+
+        if (m_max_outputs > 0 && m_outputs.size() > m_max_outputs)
+        {
+            spill_outputs();
+        }
+
+        m_header.received += result.received;
+        m_header.spent    += result.spent;
+
+        uint64_t no_of_inputs {0};
+
+        for (const txin_v& in: tx.vin)
+        {
+            if (in.type() == typeid(txin_to_key))
+            {
+                ++no_of_inputs;
+            }
+        }
+
+        // coinbase txs can't spend anything
+        if (no_of_inputs == 0)
+        {
+            return;
+        }
+
+        write_pod(m_file, height);
+        write_pod(m_file, tx_no);
+        write_pod(m_file, result.tx_hash);
+        write_pod(m_file, no_of_inputs);
+
+        for (const txin_v& in: tx.vin)
+        {
+            if (in.type() != typeid(txin_to_key))
+            {
+                continue;
+            }
+
+            const txin_to_key& tx_in_to_key = boost::get<txin_to_key>(in);
+
+            write_pod(m_file, tx_in_to_key.k_image);
+            write_pod(m_file, tx_in_to_key.amount);
+        }
+
+        ++m_header.no_of_input_txs;
+    }
+
+
+    /**
+     * Write our outputs and the final header. Spilled
+     * outputs go first, as they were found first.
+     * Only then the shard gets its final name.
+     */
+    bool
+    ScanShardWriter::close()
+    {
+        m_header.outputs_offset = static_cast<uint64_t>(m_file.tellp());
+        m_header.no_of_outputs  = m_no_of_spilled + m_outputs.size();
+
+        if (m_spill_file.is_open())
+        {
+            m_spill_file.close();
+
+            ifstream spill_file(m_spill_file_path, ios::binary);
+
+            if (m_spill_file.fail() || !spill_file.is_open()
+                || !(m_file << spill_file.rdbuf()))
+            {
+                cerr << "Cant copy spilled outputs from: "
+                     << m_spill_file_path << endl;
+                return false;
+            }
+
+            spill_file.close();
+
+            remove(m_spill_file_path.c_str());
+        }
+
+        for (const shard_output& output: m_outputs)
+        {
+            write_output(m_file, output);
+        }
+
+        m_file.seekp(0);
+
+        write_header();
+
+        m_file.close();
+
+        if (m_file.fail())
+        {
+            cerr << "Error writing shard file: " << m_tmp_file_path << endl;
+            remove(m_tmp_file_path.c_str());
+            return false;
+        }
+
+        if (rename(m_tmp_file_path.c_str(), m_file_path.c_str()) != 0)
+        {
+            cerr << "Cant rename " << m_tmp_file_path
+                 << " to " << m_file_path << endl;
+            remove(m_tmp_file_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+
+    void
+    ScanShardWriter::write_header()
+    {
+        write_header_fields(m_file, m_header);
+    }
+
+
+    /**
+     * Move our outputs from memory into the spill file,
+     * which is next to the shard file.
+     */
+    bool
+    ScanShardWriter::spill_outputs()
+    {
+        if (!m_spill_file.is_open())
+        {
+            m_spill_file_path = m_file_path + ".spill";
+
+            m_spill_file.open(m_spill_file_path, ios::binary | ios::trunc);
+
+            if (!m_spill_file.is_open())
+            {
+                cerr << "Cant open spill file: " << m_spill_file_path
+                     << ", keeping outputs in memory" << endl;
+
+                m_max_outputs = 0;
+                return false;
+            }
+        }
+
+        for (const shard_output& output: m_outputs)
+        {
+            write_output(m_spill_file, output);
+        }
+
+        m_no_of_spilled += m_outputs.size();
+
+        // swap, not clear, to give the memory back
+        vector<shard_output>().swap(m_outputs);
+
+        return true;
+    }
+
+
+    ScanShardReader::ScanShardReader(const string& file_path):
+            m_file(file_path, ios::binary | ios::ate),
+            m_file_path(file_path)
+    {
+        if (!m_file.is_open())
+        {
+            cerr << "Cant open shard file: " << m_file_path << endl;
+            return;
+        }
+
+        m_file_size = static_cast<uint64_t>(m_file.tellg());
+
+        m_file.seekg(0);
+
+        if (!read_header_fields(m_file, m_header))
+        {
+            cerr << "Not a shard file: " << m_file_path << endl;
+            return;
+        }
+
+        // inputs must fit between the header and our outputs,
+        // which must fill the rest of the file
+        if (m_header.outputs_offset < HEADER_SIZE
+            || m_header.outputs_offset > m_file_size
+            || (m_file_size - m_header.outputs_offset) / OUTPUT_SIZE
+               != m_header.no_of_outputs
+            || (m_file_size - m_header.outputs_offset) % OUTPUT_SIZE != 0)
+        {
+            cerr << "Shard file is corrupted: " << m_file_path << endl;
+            return;
+        }
+
+        m_is_valid = true;
+    }
+
+
+    bool
+    ScanShardReader::is_valid() const
+    {
+        return m_is_valid;
+    }
+
+
+    const shard_header&
+    ScanShardReader::get_header() const
+    {
+        return m_header;
+    }
+
+
+    const string&
+    ScanShardReader::get_file_path() const
+    {
+        return m_file_path;
+    }
+
+
+    bool
+    ScanShardReader::read_outputs(vector<shard_output>& outputs)
+    {
+        m_file.clear();
+        m_file.seekg(m_header.outputs_offset);
+
+        for (uint64_t i = 0; i < m_header.no_of_outputs; ++i)
+        {
+            shard_output output;
+
+            if (!(read_pod(m_file, output.height)
+                  && read_pod(m_file, output.tx_no)
+                  && read_pod(m_file, output.tx_hash)
+                  && read_pod(m_file, output.out_idx)
+                  && read_pod(m_file, output.amount)
+                  && read_pod(m_file, output.key_image)))
+            {
+                cerr << "Cant read outputs from shard file: " << m_file_path << endl;
+                return false;
+            }
+
+            outputs.push_back(output);
+        }
+
+        return rewind_inputs();
+    }
+
+
+    /**
+     * Go back to the first tx inputs, which are
+     * just after the header.
+     */
+    bool
+    ScanShardReader::rewind_inputs()
+    {
+        m_file.clear();
+        m_file.seekg(0);
+
+        shard_header header;
+
+        m_input_txs_read = 0;
+
+        return read_header_fields(m_file, header);
+    }
+
+
+    /**
+     * Read inputs of the next tx. Returns false
+     * when there are no more of them, or on error,
+     * in which case is_valid() becomes false.
+     */
+    bool
+    ScanShardReader::next_tx_inputs(shard_tx_inputs& tx_inputs)
+    {
+        if (m_input_txs_read >= m_header.no_of_input_txs)
+        {
+            return false;
+        }
+
+        uint64_t no_of_inputs;
+
+        if (!(read_pod(m_file, tx_inputs.height)
+              && read_pod(m_file, tx_inputs.tx_no)
+              && read_pod(m_file, tx_inputs.tx_hash)
+              && read_pod(m_file, no_of_inputs)))
+        {
+            cerr << "Cant read inputs from shard file: " << m_file_path << endl;
+            m_is_valid = false;
+            return false;
+        }
+
+        // make sure the count is not garbage before
+        // allocating memory for it
+        uint64_t position = static_cast<uint64_t>(m_file.tellg());
+
+        if (position > m_header.outputs_offset
+            || no_of_inputs > (m_header.outputs_offset - position) / INPUT_SIZE)
+        {
+            cerr << "Shard file is corrupted: " << m_file_path << endl;
+            m_is_valid = false;
+            return false;
+        }
+
+        tx_inputs.inputs.resize(no_of_inputs);
+
+        for (shard_input& input: tx_inputs.inputs)
+        {
+            if (!(read_pod(m_file, input.key_image)
+                  && read_pod(m_file, input.amount)))
+            {
+                cerr << "Cant read inputs from shard file: " << m_file_path << endl;
+                m_is_valid = false;
+                return false;
+            }
+        }
+
+        ++m_input_txs_read;
+
+        return true;
+    }
+
+
+    /**
+     * Scan blocks in [start_height, end_height) and
+     * write the results into the shard.
+     *
+     * If prefetcher is given, it reads ahead of the
+     * scanned blocks. If page_releaser is given, lmdb
+     * pages are kept within the memory budget.
+     */
+    bool
+    scan_height_range(BlockchainDB& db,
+                      WalletScanner& scanner,
+                      uint64_t start_height,
+                      uint64_t end_height,
+                      ScanShardWriter& shard_writer,
+                      LmdbPrefetcher* prefetcher,
+                      LmdbPageReleaser* page_releaser)
+    {
+        block                  blk;
+        vector<transaction>    txs;
+        vector<tx_scan_result> results;
+
+        if (prefetcher)
+        {
+            prefetcher->start(start_height, end_height);
+        }
+
+        for (uint64_t height = start_height; height < end_height; ++height)
+        {
+            if (prefetcher)
+            {
+                prefetcher->advance(height);
+            }
+
+            if (page_releaser)
+            {
+                page_releaser->check();
+            }
+
+            if (!get_block_and_txs(db, height, blk, txs)
+                || !scanner.scan_block(blk, txs, results))
+            {
+                return false;
+            }
+
+            // inputs of all txs go into the shard, not only of ours
+            shard_writer.add_tx(height, 0, blk.miner_tx, results[0]);
+
+            for (size_t i = 0; i < txs.size(); ++i)
+            {
+                shard_writer.add_tx(height, i + 1, txs[i], results[i + 1]);
+            }
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Merge shard files, given in any order, into the list
+     * of our txs and our outputs, in the blockchain order.
+     * Outputs have heights at which they were spent.
+     *
+     * First, our outputs from all the shards are read,
+     * as there are not many of them. Then inputs of
+     * each shard are streamed and matched against key
+     * images of these outputs.
+     *
+     * All our outputs and txs are kept in memory, so
+     * --memory-budget-mb does not apply here. They grow
+     * with the wallet's history, not with the blockchain.
+     */
+    bool
+    merge_scan_shards(const vector<string>& shard_paths,
+                      vector<merged_tx>& txs,
+                      vector<merged_output>& outputs)
+    {
+        vector<unique_ptr<ScanShardReader>> readers;
+
+        for (const string& shard_path: shard_paths)
+        {
+            readers.emplace_back(new ScanShardReader(shard_path));
+
+            if (!readers.back()->is_valid())
+            {
+                return false;
+            }
+        }
+
+        sort(readers.begin(), readers.end(),
+             [](const unique_ptr<ScanShardReader>& a,
+                const unique_ptr<ScanShardReader>& b)
+             {
+                 return a->get_header().start_height
+                        < b->get_header().start_height;
+             });
+
+        for (size_t i = 1; i < readers.size(); ++i)
+        {
+            const shard_header& prev = readers[i - 1]->get_header();
+            const shard_header& curr = readers[i]->get_header();
+
+            if (curr.wallet_hash != readers[0]->get_header().wallet_hash)
+            {
+                cerr << "Shards are of different wallets: "
+                     << readers[0]->get_file_path()
+                     << " and " << readers[i]->get_file_path() << endl;
+                return false;
+            }
+
+            if (curr.start_height < prev.end_height)
+            {
+                cerr << "Shards overlap: " << readers[i - 1]->get_file_path()
+                     << " and " << readers[i]->get_file_path() << endl;
+                return false;
+            }
+
+            if (curr.start_height > prev.end_height)
+            {
+                cerr << "Warning: blocks " << prev.end_height << " to "
+                     << curr.start_height << " are not in any shard" << endl;
+            }
+        }
+
+        // (height, tx_no) -> our tx
+        map<pair<uint64_t, uint64_t>, merged_tx> our_txs;
+
+        // key images of our outputs -> their positions in outputs
+        unordered_map<crypto::key_image, size_t> key_images;
+
+        outputs.clear();
+
+        for (const unique_ptr<ScanShardReader>& reader: readers)
+        {
+            vector<shard_output> shard_outputs;
+
+            if (!reader->read_outputs(shard_outputs))
+            {
+                return false;
+            }
+
+            for (const shard_output& output: shard_outputs)
+            {
+                merged_tx& tx = our_txs[{output.height, output.tx_no}];
+
+                tx.height   = output.height;
+                tx.tx_no    = output.tx_no;
+                tx.tx_hash  = output.tx_hash;
+                tx.received += output.amount;
+
+                key_images[output.key_image] = outputs.size();
+
+                outputs.push_back({output.height, output.tx_no,
+                                   output.tx_hash, output.out_idx,
+                                   output.amount, output.key_image,
+                                   merged_output::UNSPENT_HEIGHT});
+            }
+        }
+
+        shard_tx_inputs tx_inputs;
+
+        for (const unique_ptr<ScanShardReader>& reader: readers)
+        {
+            while (reader->next_tx_inputs(tx_inputs))
+            {
+                for (const shard_input& input: tx_inputs.inputs)
+                {
+                    auto key_image_it = key_images.find(input.key_image);
+
+                    if (key_image_it == key_images.end())
+                    {
+                        continue;
+                    }
+
+                    outputs[key_image_it->second].spent_height = tx_inputs.height;
+
+                    merged_tx& tx = our_txs[{tx_inputs.height, tx_inputs.tx_no}];
+
+                    tx.height  = tx_inputs.height;
+                    tx.tx_no   = tx_inputs.tx_no;
+                    tx.tx_hash = tx_inputs.tx_hash;
+                    tx.spent  += input.amount;
+                }
+            }
+
+            if (!reader->is_valid())
+            {
+                return false;
+            }
+        }
+
+        txs.clear();
+
+        for (const auto& our_tx: our_txs)
+        {
+            txs.push_back(our_tx.second);
+        }
+
+        return true;
+    }
+
+}
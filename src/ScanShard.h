@@ -0,0 +1,219 @@
+#ifndef XMREG01_SCANSHARD_H
+#define XMREG01_SCANSHARD_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "monero_headers.h"
+#include "WalletScanner.h"
+#include "LmdbPrefetcher.h"
+#include "LmdbPageReleaser.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Our output found in a shard. tx_no is the index of
+     * the tx in its block, with 0 being the miner tx.
+     */
+    struct shard_output
+    {
+        uint64_t          height;
+        uint64_t          tx_no;
+        crypto::hash      tx_hash;
+        uint64_t          out_idx;
+        uint64_t          amount;
+        crypto::key_image key_image;
+    };
+
+
+    struct shard_input
+    {
+        crypto::key_image key_image;
+        uint64_t          amount;
+    };
+
+
+    /**
+     * All key images in inputs of a tx. Whether they are ours
+     * is known only after merging with the shards before it.
+     */
+    struct shard_tx_inputs
+    {
+        uint64_t            height;
+        uint64_t            tx_no;
+        crypto::hash        tx_hash;
+        vector<shard_input> inputs;
+    };
+
+
+    /**
+     * Header of a shard file. received and spent are
+     * the balance deltas found within the shard alone.
+     * wallet_hash identifies the address that was scanned.
+     */
+    struct shard_header
+    {
+        crypto::hash wallet_hash {};
+        uint64_t start_height    {0};
+        uint64_t end_height      {0};
+        uint64_t no_of_input_txs {0};
+        uint64_t no_of_outputs   {0};
+        uint64_t outputs_offset  {0};
+        uint64_t received        {0};
+        uint64_t spent           {0};
+    };
+
+
+    /**
+     * Our tx after merging the shards
+     */
+    struct merged_tx
+    {
+        uint64_t     height;
+        uint64_t     tx_no;
+        crypto::hash tx_hash;
+        uint64_t     received {0};
+        uint64_t     spent    {0};
+    };
+
+
+    /**
+     * Our output after merging the shards. spent_height is
+     * the height of the tx spending it, or UNSPENT_HEIGHT.
+     */
+    struct merged_output
+    {
+        static const uint64_t UNSPENT_HEIGHT;
+
+        uint64_t          height;
+        uint64_t          tx_no;
+        crypto::hash      tx_hash;
+        uint64_t          out_idx;
+        uint64_t          amount;
+        crypto::key_image key_image;
+        uint64_t          spent_height;
+
+        bool
+        is_unspent_at(uint64_t at_height) const;
+    };
+
+
+    /**
+     * Writes results of scanning blocks in [start_height, end_height)
+     * into a shard file.
+     *
+     * The file has the header, then inputs of all txs, written as
+     * they are scanned, and then our outputs. The header is
+     * written again at the end, when all counts are known.
+     *
+     * Everything goes into <file_path>.tmp first, which is
+     * renamed to file_path only by close(). So a scan that
+     * failed or was killed does not leave a valid shard.
+     *
+     * Our outputs are kept in memory until closing, unless
+     * a memory budget is set. Then, they are spilled into
+     * a temporary file whenever they take more than the budget.
+     */
+    class ScanShardWriter {
+
+        ofstream             m_file;
+        string               m_file_path;
+        string               m_tmp_file_path;
+        shard_header         m_header;
+        vector<shard_output> m_outputs;
+
+        uint64_t             m_max_outputs    {0};
+        ofstream             m_spill_file;
+        string               m_spill_file_path;
+        uint64_t             m_no_of_spilled  {0};
+
+    public:
+        ScanShardWriter(const string& file_path,
+                        const account_public_address& address,
+                        uint64_t start_height,
+                        uint64_t end_height);
+
+        ~ScanShardWriter();
+
+        bool
+        is_open() const;
+
+        void
+        set_memory_budget(uint64_t budget);
+
+        void
+        add_tx(uint64_t height, uint64_t tx_no,
+               const transaction& tx,
+               const tx_scan_result& result);
+
+        bool
+        close();
+
+    private:
+        void
+        write_header();
+
+        bool
+        spill_outputs();
+    };
+
+
+    /**
+     * Reads a shard file written by ScanShardWriter.
+     * Inputs are read one tx at a time.
+     */
+    class ScanShardReader {
+
+        ifstream     m_file;
+        string       m_file_path;
+        uint64_t     m_file_size      {0};
+        shard_header m_header;
+        uint64_t     m_input_txs_read {0};
+        bool         m_is_valid       {false};
+
+    public:
+        ScanShardReader(const string& file_path);
+
+        bool
+        is_valid() const;
+
+        const shard_header&
+        get_header() const;
+
+        const string&
+        get_file_path() const;
+
+        bool
+        read_outputs(vector<shard_output>& outputs);
+
+        bool
+        rewind_inputs();
+
+        bool
+        next_tx_inputs(shard_tx_inputs& tx_inputs);
+    };
+
+
+    bool
+    scan_height_range(BlockchainDB& db,
+                      WalletScanner& scanner,
+                      uint64_t start_height,
+                      uint64_t end_height,
+                      ScanShardWriter& shard_writer,
+                      LmdbPrefetcher* prefetcher = nullptr,
+                      LmdbPageReleaser* page_releaser = nullptr);
+
+    bool
+    merge_scan_shards(const vector<string>& shard_paths,
+                      vector<merged_tx>& txs,
+                      vector<merged_output>& outputs);
+
+}
+
+
+#endif //XMREG01_SCANSHARD_H
@@ -0,0 +1,68 @@
+#include "TxHashFileReader.h"
+
+namespace xmreg
+{
+
+    TxHashFileReader::TxHashFileReader(const string& file_path):
+            m_file(file_path), m_file_path(file_path)
+    {
+        if (!m_file.is_open())
+        {
+            cerr << "Cant open tx hashes file: " << m_file_path << endl;
+        }
+    }
+
+
+    bool
+    TxHashFileReader::is_open() const
+    {
+        return m_file.is_open();
+    }
+
+
+    /**
+     * Read next tx hash from the file.
+     *
+     * Returns false when there are no more hashes in the file.
+     * Leading and trailing white spaces are removed.
+     */
+    bool
+    TxHashFileReader::next(string& hash_str)
+    {
+        string line;
+
+        while (getline(m_file, line))
+        {
+            ++m_line_no;
+
+            const char* white_spaces = " \t\r\n";
+
+            size_t first = line.find_first_not_of(white_spaces);
+
+            // skip empty lines and comments
+            if (first == string::npos || line[first] == '#')
+            {
+                continue;
+            }
+
+            size_t last = line.find_last_not_of(white_spaces);
+
+            hash_str = line.substr(first, last - first + 1);
+
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /**
+     * Line number of the last hash read
+     */
+    uint64_t
+    TxHashFileReader::line_no() const
+    {
+        return m_line_no;
+    }
+
+}
@@ -0,0 +1,42 @@
+#ifndef XMREG01_TXHASHFILEREADER_H
+#define XMREG01_TXHASHFILEREADER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+
+namespace xmreg
+{
+    using namespace std;
+
+    /**
+     * Reads tx hashes from a text file, one hash per line.
+     *
+     * The file is read one line at a time, so it
+     * can be arbitrary large. Empty lines and lines
+     * starting with # are skipped.
+     */
+    class TxHashFileReader {
+
+        ifstream m_file;
+        string   m_file_path;
+        uint64_t m_line_no {0};
+
+    public:
+        TxHashFileReader(const string& file_path);
+
+        bool
+        is_open() const;
+
+        bool
+        next(string& hash_str);
+
+        uint64_t
+        line_no() const;
+    };
+
+}
+
+
+#endif //XMREG01_TXHASHFILEREADER_H
@@ -0,0 +1,435 @@
+#include "TxPubKeyIndex.h"
+#include "tools.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace xmreg
+{
+
+    namespace
+    {
+        const char INDEX_MAGIC[8] = {'X', 'M', 'R', 'T', 'X', 'I', 'D', 'X'};
+
+        // structures are written to and mapped from
+        // the file as they are, so there must be no padding
+        static_assert(sizeof(tx_index_header) == 8 + 10 * sizeof(uint64_t),
+                      "tx_index_header must not have padding");
+
+        static_assert(sizeof(tx_index_entry) == 2 * 32 + 5 * sizeof(uint64_t),
+                      "tx_index_entry must not have padding");
+
+        /**
+         * Append the whole column file to the index file,
+         * and remove the column file.
+         */
+        bool
+        append_column(ofstream& index_file, const string& column_path)
+        {
+            {
+                ifstream column_file(column_path, ios::binary);
+
+                if (!column_file.is_open())
+                {
+                    cerr << "Cant open column file: " << column_path << endl;
+                    return false;
+                }
+
+                if (column_file.peek() != ifstream::traits_type::eof())
+                {
+                    index_file << column_file.rdbuf();
+                }
+            }
+
+            remove(column_path.c_str());
+
+            return static_cast<bool>(index_file);
+        }
+    }
+
+
+    TxPubKeyIndexWriter::TxPubKeyIndexWriter(const string& file_path,
+                                             uint64_t start_height,
+                                             uint64_t end_height):
+            m_file_path(file_path),
+            m_txs(column_path("txs"), ios::binary | ios::trunc),
+            m_out_keys(column_path("out_keys"), ios::binary | ios::trunc),
+            m_out_amounts(column_path("out_amounts"), ios::binary | ios::trunc),
+            m_key_images(column_path("key_images"), ios::binary | ios::trunc),
+            m_in_amounts(column_path("in_amounts"), ios::binary | ios::trunc),
+            m_header()
+    {
+        copy(begin(INDEX_MAGIC), end(INDEX_MAGIC), m_header.magic);
+
+        m_header.start_height = start_height;
+        m_header.end_height   = end_height;
+    }
+
+
+    bool
+    TxPubKeyIndexWriter::is_open() const
+    {
+        return m_txs.is_open() && m_out_keys.is_open()
+               && m_out_amounts.is_open() && m_key_images.is_open()
+               && m_in_amounts.is_open();
+    }
+
+
+    /**
+     * Add a tx to the index. Outputs other than to_key
+     * are stored with null_pkey, so that output indices
+     * stay the same as in the tx.
+     */
+    void
+    TxPubKeyIndexWriter::add_tx(uint64_t height, const transaction& tx)
+    {
+        tx_index_entry entry;
+
+        entry.height           = height;
+        entry.tx_hash          = get_transaction_hash(tx);
+        entry.tx_pub_key       = get_tx_pub_key_from_extra(tx);
+        entry.first_output     = m_header.no_of_outputs;
+        entry.no_of_outputs    = tx.vout.size();
+        entry.first_key_image  = m_header.no_of_key_images;
+        entry.no_of_key_images = 0;
+
+        for (const tx_out& out: tx.vout)
+        {
+            crypto::public_key out_key = null_pkey;
+
+            if (out.target.type() == typeid(txout_to_key))
+            {
+                out_key = boost::get<txout_to_key>(out.target).key;
+            }
+
+            write_pod(m_out_keys, out_key);
+            write_pod(m_out_amounts, out.amount);
+        }
+
+        for (const txin_v& in: tx.vin)
+        {
+            if (in.type() != typeid(txin_to_key))
+            {
+                continue;
+            }
+
+            const txin_to_key& tx_in_to_key = boost::get<txin_to_key>(in);
+
+            write_pod(m_key_images, tx_in_to_key.k_image);
+            write_pod(m_in_amounts, tx_in_to_key.amount);
+
+            ++entry.no_of_key_images;
+        }
+
+        write_pod(m_txs, entry);
+
+        m_header.no_of_txs        += 1;
+        m_header.no_of_outputs    += entry.no_of_outputs;
+        m_header.no_of_key_images += entry.no_of_key_images;
+    }
+
+
+    /**
+     * Join the header and all the columns
+     * into the index file.
+     */
+    bool
+    TxPubKeyIndexWriter::close()
+    {
+        m_txs.close();
+        m_out_keys.close();
+        m_out_amounts.close();
+        m_key_images.close();
+        m_in_amounts.close();
+
+        if (m_txs.fail() || m_out_keys.fail() || m_out_amounts.fail()
+            || m_key_images.fail() || m_in_amounts.fail())
+        {
+            cerr << "Error writing columns of index: " << m_file_path << endl;
+            return false;
+        }
+
+        m_header.txs_offset         = sizeof(tx_index_header);
+        m_header.out_keys_offset    = m_header.txs_offset
+                                      + m_header.no_of_txs * sizeof(tx_index_entry);
+        m_header.out_amounts_offset = m_header.out_keys_offset
+                                      + m_header.no_of_outputs * sizeof(crypto::public_key);
+        m_header.key_images_offset  = m_header.out_amounts_offset
+                                      + m_header.no_of_outputs * sizeof(uint64_t);
+        m_header.in_amounts_offset  = m_header.key_images_offset
+                                      + m_header.no_of_key_images * sizeof(crypto::key_image);
+
+        ofstream index_file(m_file_path, ios::binary | ios::trunc);
+
+        if (!index_file.is_open())
+        {
+            cerr << "Cant open index file for writing: " << m_file_path << endl;
+            return false;
+        }
+
+        write_pod(index_file, m_header);
+
+        return append_column(index_file, column_path("txs"))
+               && append_column(index_file, column_path("out_keys"))
+               && append_column(index_file, column_path("out_amounts"))
+               && append_column(index_file, column_path("key_images"))
+               && append_column(index_file, column_path("in_amounts"));
+    }
+
+
+    string
+    TxPubKeyIndexWriter::column_path(const string& column_name) const
+    {
+        return m_file_path + "." + column_name;
+    }
+
+
+    TxPubKeyIndex::TxPubKeyIndex()
+    {}
+
+
+    /**
+     * Memory map the index file and check that
+     * its header and columns are consistent with its size.
+     */
+    bool
+    TxPubKeyIndex::open(const string& file_path)
+    {
+        close();
+
+        m_fd = ::open(file_path.c_str(), O_RDONLY);
+
+        if (m_fd < 0)
+        {
+            cerr << "Cant open index file: " << file_path << endl;
+            return false;
+        }
+
+        struct stat file_stat;
+
+        if (fstat(m_fd, &file_stat) != 0
+            || static_cast<uint64_t>(file_stat.st_size) < sizeof(tx_index_header))
+        {
+            cerr << "Not an index file: " << file_path << endl;
+            close();
+            return false;
+        }
+
+        m_size = file_stat.st_size;
+
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            cerr << "Cant memory map index file: " << file_path << endl;
+            m_size = 0;
+            close();
+            return false;
+        }
+
+        m_data = static_cast<const char*>(data);
+
+        // the index is always read from the beginning to the end
+        madvise(data, m_size, MADV_SEQUENTIAL);
+
+        m_header = reinterpret_cast<const tx_index_header*>(m_data);
+
+        if (!is_valid())
+        {
+            cerr << "Index file is not valid: " << file_path << endl;
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Check that the columns are where the writer puts them,
+     * and that outputs and key images of every tx are within
+     * their columns, so that get_tx() never points outside
+     * of the mapped file.
+     */
+    bool
+    TxPubKeyIndex::is_valid() const
+    {
+        const tx_index_header& header = *m_header;
+
+        if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+        {
+            return false;
+        }
+
+        // counts are checked against the file size first,
+        // so that calculating the offsets can't overflow
+        if (header.no_of_txs > m_size / sizeof(tx_index_entry)
+            || header.no_of_outputs > m_size / sizeof(crypto::public_key)
+            || header.no_of_key_images > m_size / sizeof(crypto::key_image))
+        {
+            return false;
+        }
+
+        uint64_t out_keys_offset    = sizeof(tx_index_header)
+                                      + header.no_of_txs * sizeof(tx_index_entry);
+        uint64_t out_amounts_offset = out_keys_offset
+                                      + header.no_of_outputs * sizeof(crypto::public_key);
+        uint64_t key_images_offset  = out_amounts_offset
+                                      + header.no_of_outputs * sizeof(uint64_t);
+        uint64_t in_amounts_offset  = key_images_offset
+                                      + header.no_of_key_images * sizeof(crypto::key_image);
+
+        if (header.txs_offset != sizeof(tx_index_header)
+            || header.out_keys_offset != out_keys_offset
+            || header.out_amounts_offset != out_amounts_offset
+            || header.key_images_offset != key_images_offset
+            || header.in_amounts_offset != in_amounts_offset
+            || in_amounts_offset + header.no_of_key_images * sizeof(uint64_t) != m_size)
+        {
+            return false;
+        }
+
+        const tx_index_entry* entries = reinterpret_cast<const tx_index_entry*>(
+                m_data + header.txs_offset);
+
+        for (uint64_t i = 0; i < header.no_of_txs; ++i)
+        {
+            const tx_index_entry& entry = entries[i];
+
+            if (entry.first_output > header.no_of_outputs
+                || entry.no_of_outputs > header.no_of_outputs - entry.first_output
+                || entry.first_key_image > header.no_of_key_images
+                || entry.no_of_key_images > header.no_of_key_images - entry.first_key_image)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Number of txs in the index
+     */
+    uint64_t
+    TxPubKeyIndex::size() const
+    {
+        return m_header ? m_header->no_of_txs : 0;
+    }
+
+
+    indexed_tx
+    TxPubKeyIndex::get_tx(uint64_t i) const
+    {
+        const tx_index_entry* entry = reinterpret_cast<const tx_index_entry*>(
+                m_data + m_header->txs_offset) + i;
+
+        indexed_tx tx;
+
+        tx.entry       = entry;
+        tx.out_keys    = reinterpret_cast<const crypto::public_key*>(
+                                 m_data + m_header->out_keys_offset) + entry->first_output;
+        tx.out_amounts = reinterpret_cast<const uint64_t*>(
+                                 m_data + m_header->out_amounts_offset) + entry->first_output;
+        tx.key_images  = reinterpret_cast<const crypto::key_image*>(
+                                 m_data + m_header->key_images_offset) + entry->first_key_image;
+        tx.in_amounts  = reinterpret_cast<const uint64_t*>(
+                                 m_data + m_header->in_amounts_offset) + entry->first_key_image;
+
+        return tx;
+    }
+
+
+    void
+    TxPubKeyIndex::close()
+    {
+        if (m_data)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+
+        m_fd     = -1;
+        m_data   = nullptr;
+        m_size   = 0;
+        m_header = nullptr;
+    }
+
+
+    TxPubKeyIndex::~TxPubKeyIndex()
+    {
+        close();
+    }
+
+
+    /**
+     * One time pass over blocks in [start_height, end_height),
+     * writing all their txs into the index file.
+     *
+     * If prefetcher is given, it reads ahead of the
+     * indexed blocks. If page_releaser is given, lmdb
+     * pages are kept within the memory budget.
+     */
+    bool
+    build_tx_pubkey_index(BlockchainDB& db,
+                          uint64_t start_height,
+                          uint64_t end_height,
+                          const string& file_path,
+                          LmdbPrefetcher* prefetcher,
+                          LmdbPageReleaser* page_releaser)
+    {
+        TxPubKeyIndexWriter writer {file_path, start_height, end_height};
+
+        if (!writer.is_open())
+        {
+            cerr << "Cant create index file: " << file_path << endl;
+            return false;
+        }
+
+        if (prefetcher)
+        {
+            prefetcher->start(start_height, end_height);
+        }
+
+        for (uint64_t height = start_height; height < end_height; ++height)
+        {
+            if (prefetcher)
+            {
+                prefetcher->advance(height);
+            }
+
+            if (page_releaser)
+            {
+                page_releaser->check();
+            }
+
+            block blk;
+            vector<transaction> txs;
+
+            if (!get_block_and_txs(db, height, blk, txs))
+            {
+                return false;
+            }
+
+            writer.add_tx(height, blk.miner_tx);
+
+            for (const transaction& tx: txs)
+            {
+                writer.add_tx(height, tx);
+            }
+        }
+
+        return writer.close();
+    }
+
+}
@@ -0,0 +1,159 @@
+#ifndef XMREG01_TXPUBKEYINDEX_H
+#define XMREG01_TXPUBKEYINDEX_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "monero_headers.h"
+#include "LmdbPrefetcher.h"
+#include "LmdbPageReleaser.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    /**
+     * Header of the tx public key index file.
+     * Offsets are in bytes from the start of the file.
+     */
+    struct tx_index_header
+    {
+        char     magic[8];
+        uint64_t start_height;
+        uint64_t end_height;
+        uint64_t no_of_txs;
+        uint64_t no_of_outputs;
+        uint64_t no_of_key_images;
+        uint64_t txs_offset;
+        uint64_t out_keys_offset;
+        uint64_t out_amounts_offset;
+        uint64_t key_images_offset;
+        uint64_t in_amounts_offset;
+    };
+
+
+    /**
+     * Row of the txs column. Its outputs are
+     * [first_output, first_output + no_of_outputs) in
+     * the out_keys and out_amounts columns, and similarly
+     * for key images of its inputs.
+     */
+    struct tx_index_entry
+    {
+        uint64_t           height;
+        crypto::hash       tx_hash;
+        crypto::public_key tx_pub_key;
+        uint64_t           first_output;
+        uint64_t           no_of_outputs;
+        uint64_t           first_key_image;
+        uint64_t           no_of_key_images;
+    };
+
+
+    /**
+     * A tx as read from the index. Pointers point
+     * directly into the memory mapped file.
+     */
+    struct indexed_tx
+    {
+        const tx_index_entry*     entry;
+        const crypto::public_key* out_keys;
+        const uint64_t*           out_amounts;
+        const crypto::key_image*  key_images;
+        const uint64_t*           in_amounts;
+    };
+
+
+    /**
+     * Writes the index file with, for each tx in the given
+     * blocks, its height, hash, public key, its output keys
+     * and amounts, and key images (and amounts) of its inputs.
+     *
+     * Each column is first written into its own temporary file,
+     * and then they are all joined into the index file in close().
+     */
+    class TxPubKeyIndexWriter {
+
+        string   m_file_path;
+        ofstream m_txs;
+        ofstream m_out_keys;
+        ofstream m_out_amounts;
+        ofstream m_key_images;
+        ofstream m_in_amounts;
+
+        tx_index_header m_header;
+
+    public:
+        TxPubKeyIndexWriter(const string& file_path,
+                            uint64_t start_height,
+                            uint64_t end_height);
+
+        bool
+        is_open() const;
+
+        void
+        add_tx(uint64_t height, const transaction& tx);
+
+        bool
+        close();
+
+    private:
+        string
+        column_path(const string& column_name) const;
+    };
+
+
+    /**
+     * Memory maps the index file for reading.
+     *
+     * The kernel is told that the file is read sequentially,
+     * so scanning it is limited mostly by the memory bandwidth.
+     */
+    class TxPubKeyIndex {
+
+        int                    m_fd       {-1};
+        const char*            m_data     {nullptr};
+        uint64_t               m_size     {0};
+        const tx_index_header* m_header   {nullptr};
+
+    public:
+        TxPubKeyIndex();
+
+        TxPubKeyIndex(const TxPubKeyIndex&) = delete;
+        TxPubKeyIndex& operator=(const TxPubKeyIndex&) = delete;
+
+        bool
+        open(const string& file_path);
+
+        uint64_t
+        size() const;
+
+        indexed_tx
+        get_tx(uint64_t i) const;
+
+        void
+        close();
+
+        virtual ~TxPubKeyIndex();
+
+    private:
+        bool
+        is_valid() const;
+    };
+
+
+    bool
+    build_tx_pubkey_index(BlockchainDB& db,
+                          uint64_t start_height,
+                          uint64_t end_height,
+                          const string& file_path,
+                          LmdbPrefetcher* prefetcher = nullptr,
+                          LmdbPageReleaser* page_releaser = nullptr);
+
+}
+
+
+#endif //XMREG01_TXPUBKEYINDEX_H
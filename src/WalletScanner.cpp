@@ -0,0 +1,414 @@
+#include "WalletScanner.h"
+#include "PaymentIdIndex.h"
+
+namespace xmreg
+{
+
+    bool
+    tx_scan_result::is_ours() const
+    {
+        return !outputs.empty() || !inputs.empty();
+    }
+
+
+    WalletScanner::WalletScanner(const crypto::secret_key& private_view_key,
+                                 const crypto::secret_key& private_spend_key,
+                                 shared_ptr<KeyImageFilter> key_image_filter):
+            m_private_view_key(private_view_key),
+            m_private_spend_key(private_spend_key),
+            m_key_image_filter(key_image_filter)
+    {
+        crypto::secret_key_to_public_key(private_spend_key, m_public_spend_key);
+
+        // no filter shared with other scanners,
+        // so use our own one
+        if (!m_key_image_filter)
+        {
+            m_key_image_filter = make_shared<KeyImageFilter>();
+        }
+    }
+
+
+    /**
+     * View-only scanner. It finds our outputs, but does not generate
+     * their key images.
+     */
+    WalletScanner::WalletScanner(const crypto::secret_key& private_view_key,
+                                 const crypto::public_key& public_spend_key,
+                                 shared_ptr<KeyImageFilter> key_image_filter):
+            m_private_view_key(private_view_key),
+            m_public_spend_key(public_spend_key),
+            m_key_image_filter(key_image_filter)
+    {
+        if (!m_key_image_filter)
+        {
+            m_key_image_filter = make_shared<KeyImageFilter>();
+        }
+    }
+
+
+    /**
+     * Check outputs and inputs of a single tx.
+     *
+     * Outputs are checked first, as the tx can
+     * send us change back, and then inputs.
+     */
+    bool
+    WalletScanner::scan_tx(const transaction& tx, tx_scan_result& result)
+    {
+        if (!scan_outputs(tx, result))
+        {
+            return false;
+        }
+
+        return scan_inputs(tx, result);
+    }
+
+
+    /**
+     * Check the miner tx and the given txs of a block.
+     *
+     * txs must be the transactions listed in blk.tx_hashes,
+     * in the same order. results has a result for every tx,
+     * the miner tx first, so that its position is the tx number
+     * in the block. Use is_ours() to find our txs.
+     */
+    bool
+    WalletScanner::scan_block(const block& blk,
+                              const vector<transaction>& txs,
+                              vector<tx_scan_result>& results)
+    {
+        if (txs.size() != blk.tx_hashes.size())
+        {
+            cerr << "Number of txs does not match the block: "
+                 << get_block_hash(blk) << endl;
+            return false;
+        }
+
+        results.resize(txs.size() + 1);
+
+        if (!scan_tx(blk.miner_tx, results[0]))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < txs.size(); ++i)
+        {
+            if (!scan_tx(txs[i], results[i + 1]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Add key image of our output, generated outside
+     * of the scanner, e.g., in the view-only mode.
+     */
+    void
+    WalletScanner::add_key_image(const owned_output& output)
+    {
+        if (!output.has_key_image)
+        {
+            return;
+        }
+
+        m_key_images[output.key_image] = {output.tx_hash, output.out_idx};
+        m_key_image_filter->add(output.key_image);
+    }
+
+
+    void
+    WalletScanner::set_payment_id_index(shared_ptr<PaymentIdIndex> payment_id_index)
+    {
+        m_payment_id_index = payment_id_index;
+    }
+
+
+    /**
+     * Find outputs that are ours, based on the
+     * private view key, and generate their key images,
+     * if we have the private spend key.
+     */
+    bool
+    WalletScanner::scan_outputs(const transaction& tx, tx_scan_result& result)
+    {
+        // outputs of txs without a valid public key can't
+        // be ours, but their inputs still need to be checked
+        if (!start_tx(get_transaction_hash(tx),
+                      get_tx_pub_key_from_extra(tx),
+                      result))
+        {
+            return true;
+        }
+
+        for (size_t i = 0; i < tx.vout.size(); ++i)
+        {
+            // outputs of other types than to_key
+            // can't be ours
+            if (tx.vout[i].target.type() != typeid(txout_to_key))
+            {
+                continue;
+            }
+
+            const txout_to_key& tx_out_to_key
+                    = boost::get<txout_to_key>(tx.vout[i].target);
+
+            if (!check_output(i, tx_out_to_key.key, tx.vout[i].amount, result))
+            {
+                return false;
+            }
+        }
+
+        // payment ids of txs that are not ours are of
+        // no use, so don't parse tx extra for them
+        if (result.outputs.empty())
+        {
+            return true;
+        }
+
+        // encrypted payment ids are decrypted with the
+        // derivation already made for checking the outputs
+        result.has_payment_id = get_payment_id(tx, result.derivation,
+                                               result.payment_id,
+                                               result.payment_id_encrypted);
+
+        if (m_payment_id_index)
+        {
+            m_payment_id_index->add(result);
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Find inputs that are ours, i.e., their key images
+     * match key images of our earlier outputs.
+     *
+     * It must be called after scan_outputs()
+     * for the same tx and result.
+     */
+    bool
+    WalletScanner::scan_inputs(const transaction& tx, tx_scan_result& result)
+    {
+        for (size_t i = 0; i < tx.vin.size(); ++i)
+        {
+            // coinbase inputs can't be ours
+            if (tx.vin[i].type() != typeid(txin_to_key))
+            {
+                continue;
+            }
+
+            const txin_to_key& tx_in_to_key
+                    = boost::get<txin_to_key>(tx.vin[i]);
+
+            check_input(i, tx_in_to_key.k_image, tx_in_to_key.amount, result);
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Same as scan_tx() for a tx, but using only what
+     * is in the tx public key index.
+     */
+    bool
+    WalletScanner::scan_tx(const indexed_tx& tx, tx_scan_result& result)
+    {
+        if (!scan_outputs(tx, result))
+        {
+            return false;
+        }
+
+        return scan_inputs(tx, result);
+    }
+
+
+    bool
+    WalletScanner::scan_outputs(const indexed_tx& tx, tx_scan_result& result)
+    {
+        // same as for a transaction, txs without
+        // a valid public key have only inputs checked
+        if (!start_tx(tx.entry->tx_hash, tx.entry->tx_pub_key, result))
+        {
+            return true;
+        }
+
+        for (uint64_t i = 0; i < tx.entry->no_of_outputs; ++i)
+        {
+            // outputs other than to_key are
+            // indexed with null_pkey
+            if (tx.out_keys[i] == null_pkey)
+            {
+                continue;
+            }
+
+            if (!check_output(i, tx.out_keys[i], tx.out_amounts[i], result))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Index has only key images of to_key inputs, so in_idx
+     * in the results is the index among these inputs.
+     */
+    bool
+    WalletScanner::scan_inputs(const indexed_tx& tx, tx_scan_result& result)
+    {
+        for (uint64_t i = 0; i < tx.entry->no_of_key_images; ++i)
+        {
+            check_input(i, tx.key_images[i], tx.in_amounts[i], result);
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Reset the result for a new tx and get the derivation
+     * used to check all its outputs.
+     *
+     * Returns false if the tx has no valid public key, e.g., some
+     * old txs, and its outputs can't be checked. This is not
+     * an error when scanning whole blocks, so nothing is printed.
+     */
+    bool
+    WalletScanner::start_tx(const crypto::hash& tx_hash,
+                            const crypto::public_key& tx_pub_key,
+                            tx_scan_result& result)
+    {
+        result = tx_scan_result {};
+
+        result.tx_hash    = tx_hash;
+        result.tx_pub_key = tx_pub_key;
+
+        if (result.tx_pub_key == null_pkey)
+        {
+            return false;
+        }
+
+        // public transaction key is combined with our private view key
+        // to create, so called, derived key.
+        result.has_derivation = generate_key_derivation(result.tx_pub_key,
+                                                        m_private_view_key,
+                                                        result.derivation);
+
+        return result.has_derivation;
+    }
+
+
+    /**
+     * Check if the output is ours, and if so,
+     * add it to the result.
+     */
+    bool
+    WalletScanner::check_output(uint64_t out_idx,
+                                const crypto::public_key& out_key,
+                                uint64_t amount,
+                                tx_scan_result& result)
+    {
+        // get the tx output public key
+        // that would be ours
+        crypto::public_key pubkey;
+
+        crypto::derive_public_key(result.derivation, out_idx,
+                                  m_public_spend_key,
+                                  pubkey);
+
+        if (out_key != pubkey)
+        {
+            return true;
+        }
+
+        owned_output output;
+
+        output.tx_hash     = result.tx_hash;
+        output.out_idx     = out_idx;
+        output.out_pub_key = out_key;
+        output.amount      = amount;
+
+        // in the view-only mode, this is all
+        // the work done for our output.
+        //
+        // key image is generated using the output key
+        // we have just checked, and the derivation of the tx,
+        // so only the secret part is derived here.
+        if (m_private_spend_key)
+        {
+            if (!generate_output_key_image(result.derivation, out_idx,
+                                           *m_private_spend_key,
+                                           out_key,
+                                           output.key_image))
+            {
+                cerr << "Cant generate key image for tx: "
+                     << result.tx_hash << endl;
+                return false;
+            }
+
+            output.has_key_image = true;
+
+            // keep it to use it later for checking
+            // for our inputs (i.e. spend xmr)
+            add_key_image(output);
+        }
+
+        result.received += output.amount;
+
+        result.outputs.push_back(output);
+
+        return true;
+    }
+
+
+    /**
+     * Check if the key image of an input is one of ours,
+     * and if so, add the input to the result.
+     */
+    void
+    WalletScanner::check_input(uint64_t in_idx,
+                               const crypto::key_image& key_image,
+                               uint64_t amount,
+                               tx_scan_result& result)
+    {
+        // most inputs are not ours, and the filter
+        // tells it with a single memory access
+        if (!m_key_image_filter->may_contain(key_image))
+        {
+            return;
+        }
+
+        auto it = m_key_images.find(key_image);
+
+        if (it == m_key_images.end())
+        {
+            return;
+        }
+
+        spent_input input;
+
+        input.in_idx       = in_idx;
+        input.key_image    = key_image;
+        input.amount       = amount;
+        input.spent_output = it->second;
+
+        // an output is spent only once, so only key images
+        // of unspent outputs are kept. the filter can't
+        // remove them, but its size is fixed.
+        m_key_images.erase(it);
+
+        result.spent += input.amount;
+
+        result.inputs.push_back(input);
+    }
+
+}
@@ -0,0 +1,184 @@
+#ifndef XMREG01_WALLETSCANNER_H
+#define XMREG01_WALLETSCANNER_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "monero_headers.h"
+#include "tools.h"
+#include "KeyImageFilter.h"
+#include "TxPubKeyIndex.h"
+
+
+namespace xmreg
+{
+    using namespace cryptonote;
+    using namespace std;
+
+    class PaymentIdIndex;
+
+    /**
+     * Output of a tx that belongs to the scanned wallet.
+     *
+     * In the view-only mode, key_image is not known
+     * when the output is found, and has_key_image is false.
+     */
+    struct owned_output
+    {
+        crypto::hash       tx_hash;
+        uint64_t           out_idx;
+        crypto::public_key out_pub_key;
+        uint64_t           amount;
+        crypto::key_image  key_image;
+        bool               has_key_image {false};
+    };
+
+
+    /**
+     * Input of a tx that spends one of wallet's outputs.
+     * spent_output is (tx hash, output index) of that output.
+     */
+    struct spent_input
+    {
+        uint64_t           in_idx;
+        crypto::key_image  key_image;
+        uint64_t           amount;
+        tx_out_index       spent_output;
+    };
+
+
+    /**
+     * What WalletScanner found in a single tx.
+     *
+     * has_derivation is false for txs without a valid public key.
+     * Their outputs can't be ours and are not checked, but their
+     * inputs are.
+     *
+     * Payment id is looked for only in txs with our outputs.
+     */
+    struct tx_scan_result
+    {
+        crypto::hash           tx_hash;
+        crypto::public_key     tx_pub_key;
+        crypto::key_derivation derivation;
+        bool                   has_derivation {false};
+
+        crypto::hash           payment_id;
+        bool                   has_payment_id       {false};
+        bool                   payment_id_encrypted {false};
+
+        vector<owned_output>   outputs;
+        vector<spent_input>    inputs;
+
+        uint64_t               received {0};
+        uint64_t               spent    {0};
+
+        bool
+        is_ours() const;
+    };
+
+
+    /**
+     * Checks which outputs and inputs of transactions
+     * belong to a wallet with the given private view
+     * and spend keys.
+     *
+     * It keeps key images of our unspent outputs found so far,
+     * so transactions must be scanned in the order they
+     * are in the blockchain for the spendings to be found.
+     *
+     * Nothing is printed out, except errors. All
+     * findings are returned in tx_scan_result.
+     *
+     * Without the private spend key (view-only mode), only
+     * incoming outputs are found. Their key images can be generated
+     * elsewhere, e.g., in KeyImageGenerator, and given back
+     * using add_key_image(), so that spendings can be found as well.
+     *
+     * Key images of inputs are first checked against
+     * a KeyImageFilter, which can be shared by scanners
+     * of many wallets, and only if it passes, against
+     * the exact key images of this wallet.
+     *
+     * If a PaymentIdIndex is set, our outputs of txs
+     * with payment ids are added to it.
+     */
+    class WalletScanner {
+
+        crypto::secret_key m_private_view_key;
+        crypto::public_key m_public_spend_key;
+
+        // not set in the view-only mode
+        boost::optional<crypto::secret_key> m_private_spend_key;
+
+        // key images of our unspent outputs found so far,
+        // and (tx hash, output index) of the outputs
+        unordered_map<crypto::key_image, tx_out_index> m_key_images;
+
+        shared_ptr<KeyImageFilter> m_key_image_filter;
+
+        shared_ptr<PaymentIdIndex> m_payment_id_index;
+
+    public:
+        WalletScanner(const crypto::secret_key& private_view_key,
+                      const crypto::secret_key& private_spend_key,
+                      shared_ptr<KeyImageFilter> key_image_filter = nullptr);
+
+        WalletScanner(const crypto::secret_key& private_view_key,
+                      const crypto::public_key& public_spend_key,
+                      shared_ptr<KeyImageFilter> key_image_filter = nullptr);
+
+        bool
+        scan_tx(const transaction& tx, tx_scan_result& result);
+
+        bool
+        scan_outputs(const transaction& tx, tx_scan_result& result);
+
+        bool
+        scan_inputs(const transaction& tx, tx_scan_result& result);
+
+        bool
+        scan_tx(const indexed_tx& tx, tx_scan_result& result);
+
+        bool
+        scan_outputs(const indexed_tx& tx, tx_scan_result& result);
+
+        bool
+        scan_inputs(const indexed_tx& tx, tx_scan_result& result);
+
+        void
+        add_key_image(const owned_output& output);
+
+        void
+        set_payment_id_index(shared_ptr<PaymentIdIndex> payment_id_index);
+
+        bool
+        scan_block(const block& blk,
+                   const vector<transaction>& txs,
+                   vector<tx_scan_result>& results);
+
+    private:
+        bool
+        start_tx(const crypto::hash& tx_hash,
+                 const crypto::public_key& tx_pub_key,
+                 tx_scan_result& result);
+
+        bool
+        check_output(uint64_t out_idx,
+                     const crypto::public_key& out_key,
+                     uint64_t amount,
+                     tx_scan_result& result);
+
+        void
+        check_input(uint64_t in_idx,
+                    const crypto::key_image& key_image,
+                    uint64_t amount,
+                    tx_scan_result& result);
+    };
+
+}
+
+
+#endif //XMREG01_WALLETSCANNER_H
@@ -4,6 +4,17 @@
 
 #include "tools.h"
 
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <boost/algorithm/string/trim.hpp>
+
 namespace xmreg
 {
 
@@ -52,14 +63,29 @@ namespace xmreg
      */
     bool
     get_tx_from_str_hash(Blockchain& core_storage, const string& hash_str, transaction& tx)
+    {
+        return get_tx_from_str_hash(core_storage.get_db(), hash_str, tx);
+    }
+
+
+    /**
+     * Same as above, but reads directly from the database,
+     * e.g., one opened by LmdbStorage.
+     */
+    bool
+    get_tx_from_str_hash(BlockchainDB& db, const string& hash_str, transaction& tx)
     {
         crypto::hash tx_hash;
-        parse_hash256(hash_str, tx_hash);
+
+        if (!parse_hash256(hash_str, tx_hash))
+        {
+            return false;
+        }
 
         try
         {
             // get transaction with given hash
-            tx = core_storage.get_db().get_tx(tx_hash);
+            tx = db.get_tx(tx_hash);
         }
         catch (const TX_DNE& e)
         {
@@ -70,6 +96,39 @@ namespace xmreg
         return true;
     }
 
+    /**
+     * Get block at the given height and its txs,
+     * in the order of blk.tx_hashes. The miner tx
+     * is only in the block.
+     */
+    bool
+    get_block_and_txs(BlockchainDB& db,
+                      uint64_t height,
+                      block& blk,
+                      vector<transaction>& txs)
+    {
+        try
+        {
+            blk = db.get_block_from_height(height);
+
+            txs.clear();
+            txs.reserve(blk.tx_hashes.size());
+
+            for (const crypto::hash& tx_hash: blk.tx_hashes)
+            {
+                txs.push_back(db.get_tx(tx_hash));
+            }
+        }
+        catch (const std::exception& e)
+        {
+            cerr << "Cant read block at height " << height
+                 << ": " << e.what() << endl;
+            return false;
+        }
+
+        return true;
+    }
+
     /**
      * Parse monero address in a string form into
      * cryptonote::account_public_address object
@@ -153,22 +212,45 @@ namespace xmreg
                        crypto::key_image& key_img)
     {
 
-        cryptonote::keypair in_ephemeral;
+        crypto::public_key out_pub_key;
 
         if (!crypto::derive_public_key(derivation, i,
                                   pub_key,
-                                  in_ephemeral.pub))
+                                  out_pub_key))
         {
             cerr << "Error generating publick key " << pub_key << endl;
             return false;
         }
 
+        return generate_output_key_image(derivation, i, sec_key,
+                                         out_pub_key, key_img);
+    }
+
+
+    /*
+     * Generate key_image of an ith output, whose public key
+     * is already known, e.g., our output found in a tx.
+     *
+     * Public key of our output is the same as the one derived
+     * from the public spend key, so there is no need to
+     * derive it again, as generate_key_image() does.
+     */
+    bool
+    generate_output_key_image(const crypto::key_derivation& derivation,
+                              const std::size_t i,
+                              const crypto::secret_key& sec_key,
+                              const crypto::public_key& out_pub_key,
+                              crypto::key_image& key_img)
+    {
+
+        crypto::secret_key out_sec_key;
+
         try
         {
 
             crypto::derive_secret_key(derivation, i,
                                       sec_key,
-                                      in_ephemeral.sec);
+                                      out_sec_key);
         }
         catch(const std::exception& e)
         {
@@ -179,8 +261,8 @@ namespace xmreg
 
         try
         {
-            crypto::generate_key_image(in_ephemeral.pub,
-                                       in_ephemeral.sec,
+            crypto::generate_key_image(out_pub_key,
+                                       out_sec_key,
                                        key_img);
         }
         catch(const std::exception& e)
@@ -205,4 +287,244 @@ namespace xmreg
         return default_monero_dir + string("/lmdb");
     }
 
+
+
+    /**
+     * Read xmr amounts, e.g., 1.321, one per line, from a text file.
+     * Empty lines and lines starting with # are skipped.
+     */
+    bool
+    read_balances_file(const string& file_path,
+                       vector<uint64_t>& balances)
+    {
+        ifstream balances_file(file_path);
+
+        if (!balances_file.is_open())
+        {
+            cerr << "Cant open balances file: " << file_path << endl;
+            return false;
+        }
+
+        string line;
+
+        while (getline(balances_file, line))
+        {
+            boost::trim(line);
+
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            uint64_t amount;
+
+            if (!parse_amount(amount, line))
+            {
+                cerr << "Cant parse amount: " << line << endl;
+                return false;
+            }
+
+            balances.push_back(amount);
+        }
+
+        return true;
+    }
+
+
+
+    /**
+     * Parse plain (64 hex chars) or encrypted (16 hex chars)
+     * payment id. Encrypted ones are padded with zeros,
+     * same as in get_payment_id(), and encrypted is set.
+     */
+    bool
+    parse_str_payment_id(const string& payment_id_str,
+                         crypto::hash& payment_id,
+                         bool& encrypted)
+    {
+        const size_t PLAIN_PAYMENT_ID_STR_SIZE     = 2 * sizeof(crypto::hash);
+        const size_t ENCRYPTED_PAYMENT_ID_STR_SIZE = 16;
+
+        string hash_str = payment_id_str;
+
+        encrypted = hash_str.size() == ENCRYPTED_PAYMENT_ID_STR_SIZE;
+
+        if (encrypted)
+        {
+            hash_str.append(PLAIN_PAYMENT_ID_STR_SIZE
+                            - ENCRYPTED_PAYMENT_ID_STR_SIZE, '0');
+        }
+
+        if (hash_str.size() != PLAIN_PAYMENT_ID_STR_SIZE
+            || !parse_hash256(hash_str, payment_id))
+        {
+            cerr << "Cant parse payment id: " << payment_id_str << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Get payment id from the extra nonce of a tx.
+     *
+     * Plain payment ids have 32 bytes. Encrypted ones
+     * have 8 bytes, and are decrypted using the tx derivation,
+     * i.e., the one made with our private view key. They are
+     * returned padded with zeros to 32 bytes, as simplewallet does.
+     */
+    bool
+    get_payment_id(const transaction& tx,
+                   const crypto::key_derivation& derivation,
+                   crypto::hash& payment_id,
+                   bool& encrypted)
+    {
+        vector<tx_extra_field> tx_extra_fields;
+
+        // extra can be partially parsed, so we
+        // don't give up if it fails
+        parse_tx_extra(tx.extra, tx_extra_fields);
+
+        tx_extra_nonce extra_nonce;
+
+        if (!find_tx_extra_field_by_type(tx_extra_fields, extra_nonce))
+        {
+            return false;
+        }
+
+        if (get_payment_id_from_tx_extra_nonce(extra_nonce.nonce, payment_id))
+        {
+            encrypted = false;
+            return true;
+        }
+
+        crypto::hash8 encrypted_payment_id;
+
+        if (!get_encrypted_payment_id_from_tx_extra_nonce(extra_nonce.nonce,
+                                                          encrypted_payment_id))
+        {
+            return false;
+        }
+
+        // same as decrypt_payment_id(), but with the derivation
+        // we already have, not to generate it again for every tx.
+        // the derivation with this tail byte is hashed into the key.
+        const char ENCRYPTED_PAYMENT_ID_TAIL = static_cast<char>(0x8d);
+
+        char data[sizeof(crypto::key_derivation) + 1];
+
+        memcpy(data, &derivation, sizeof(crypto::key_derivation));
+        data[sizeof(crypto::key_derivation)] = ENCRYPTED_PAYMENT_ID_TAIL;
+
+        crypto::hash encryption_key;
+
+        crypto::cn_fast_hash(data, sizeof(data), encryption_key);
+
+        payment_id = null_hash;
+
+        for (size_t i = 0; i < sizeof(crypto::hash8); ++i)
+        {
+            payment_id.data[i] = encrypted_payment_id.data[i]
+                                 ^ encryption_key.data[i];
+        }
+
+        encrypted = true;
+        return true;
+    }
+
+
+
+    /**
+     * Peak resident memory of this process, in kB.
+     */
+    uint64_t
+    get_peak_rss_kb()
+    {
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+
+        // ru_maxrss is already in kB on linux
+        return static_cast<uint64_t>(usage.ru_maxrss);
+    }
+
+
+    /**
+     * Current resident memory of this process, in kB.
+     * Cheap enough to be called every few blocks.
+     */
+    uint64_t
+    get_current_rss_kb()
+    {
+        ifstream statm_file("/proc/self/statm");
+
+        uint64_t total_pages, resident_pages;
+
+        if (!(statm_file >> total_pages >> resident_pages))
+        {
+            return 0;
+        }
+
+        return resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+
+    /**
+     * Fraction of pages of the file which are in the page
+     * cache. For data.mdb, close to 0 means a cold scan,
+     * close to 1 a warm one. 0 is also returned on errors.
+     */
+    double
+    get_resident_fraction(const string& file_path)
+    {
+        int fd = ::open(file_path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            cerr << "Cant open file: " << file_path << endl;
+            return 0.0;
+        }
+
+        struct stat file_stat;
+
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+        {
+            ::close(fd);
+            return 0.0;
+        }
+
+        uint64_t file_size = file_stat.st_size;
+        uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+        void* data = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        ::close(fd);
+
+        if (data == MAP_FAILED)
+        {
+            return 0.0;
+        }
+
+        vector<unsigned char> pages_in_core((file_size + page_size - 1) / page_size);
+
+        double fraction {0.0};
+
+        if (mincore(data, file_size, pages_in_core.data()) == 0)
+        {
+            uint64_t no_of_resident = count_if(
+                    pages_in_core.begin(), pages_in_core.end(),
+                    [](unsigned char page) { return page & 1; });
+
+            fraction = static_cast<double>(no_of_resident) / pages_in_core.size();
+        }
+
+        munmap(data, file_size);
+
+        return fraction;
+    }
+
 }
@@ -8,6 +8,7 @@
 #define PATH_SEPARARTOR '/'
 
 #include <string>
+#include <iostream>
 
 #include "monero_headers.h"
 
@@ -36,6 +37,17 @@ namespace xmreg
                      const string& hash_str,
                      transaction& tx);
 
+    bool
+    get_tx_from_str_hash(BlockchainDB& db,
+                         const string& hash_str,
+                         transaction& tx);
+
+    bool
+    get_block_and_txs(BlockchainDB& db,
+                      uint64_t height,
+                      block& blk,
+                      vector<transaction>& txs);
+
     bool
     parse_str_address(const string& address_str,
                       account_public_address& address);
@@ -61,6 +73,51 @@ namespace xmreg
     string
     get_default_lmdb_folder();
 
+    bool
+    parse_str_payment_id(const string& payment_id_str,
+                         crypto::hash& payment_id,
+                         bool& encrypted);
+
+    bool
+    get_payment_id(const transaction& tx,
+                   const crypto::key_derivation& derivation,
+                   crypto::hash& payment_id,
+                   bool& encrypted);
+
+    uint64_t
+    get_peak_rss_kb();
+
+    uint64_t
+    get_current_rss_kb();
+
+    double
+    get_resident_fraction(const string& file_path);
+
+    bool
+    read_balances_file(const string& file_path,
+                       vector<uint64_t>& balances);
+
+
+    /**
+     * Write and read a value as it is in memory. Used for
+     * binary files of this program, e.g., shards, the ledger
+     * and indices, which are read on the same machine.
+     */
+    template <typename T>
+    void
+    write_pod(ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool
+    read_pod(istream& is, T& value)
+    {
+        return static_cast<bool>(
+                is.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
     bool
     generate_key_image(const crypto::key_derivation& derivation,
                        const std::size_t output_index,
@@ -68,6 +125,13 @@ namespace xmreg
                        const crypto::public_key& pub_key,
                        crypto::key_image& key_img);
 
+    bool
+    generate_output_key_image(const crypto::key_derivation& derivation,
+                              const std::size_t output_index,
+                              const crypto::secret_key& sec_key,
+                              const crypto::public_key& out_pub_key,
+                              crypto::key_image& key_img);
+
 
 }
 
@@ -0,0 +1,651 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+
+#include "../src/monero_headers.h"
+#include "../src/tools.h"
+
+
+using namespace std;
+using namespace cryptonote;
+
+namespace bf = boost::filesystem;
+
+
+// without this it wont work, same as in main.cpp
+
+namespace epee {
+    unsigned int g_test_dbg_lock_sleep = 0;
+}
+
+
+namespace
+{
+    /**
+     * Input of a planned tx. It spends either our output,
+     * given by the example tx number (from 1) and output index,
+     * or an output of the miner tx in the block before,
+     * which stands for someone sending us xmr.
+     */
+    struct planned_input
+    {
+        bool     is_ours;
+        uint64_t tx_no;
+        uint64_t out_idx;
+        string   amount;
+    };
+
+
+    struct planned_output
+    {
+        bool   is_ours;
+        string amount;
+    };
+
+
+    struct planned_tx
+    {
+        vector<planned_input>  inputs;
+        vector<planned_output> outputs;
+    };
+
+
+    planned_input
+    ours(uint64_t tx_no, uint64_t out_idx)
+    {
+        return {true, tx_no, out_idx, string {}};
+    }
+
+    planned_input
+    funds(const string& amount)
+    {
+        return {false, 0, 0, amount};
+    }
+
+    planned_output
+    ours(const string& amount)
+    {
+        return {true, amount};
+    }
+
+    planned_output
+    other(const string& amount)
+    {
+        return {false, amount};
+    }
+
+
+    /**
+     * The 18 example txs of the README, with the same outputs
+     * and inputs that are ours, the same amounts and fees.
+     * Amounts of outputs that are not ours are made up, so that
+     * inputs cover outputs and the fee.
+     *
+     * So scanning them with the example keys gives the same
+     * balances as the real txs on the mainnet.
+     */
+    const vector<planned_tx> EXAMPLE_TXS {
+            // 1: receives 2.24
+            {{funds("1.85"), funds("0.1"), funds("0.1"), funds("0.1"), funds("0.1")},
+             {ours("0.04"), ours("0.2"), ours("2")}},
+            // 2: receives 1.321
+            {{funds("2.231"), funds("0.1")},
+             {ours("0.001"), ours("0.02"), other("0.5"), ours("0.3"), other("0.5"), ours("1")}},
+            // 3: receives 0.6
+            {{funds("2.11")},
+             {other("0.5"), other("0.5"), ours("0.6"), other("0.5")}},
+            // 4: spends 2, fee 0.02
+            {{ours(1, 2)},
+             {other("0.68"), ours("0.2"), other("0.1"), ours("1")}},
+            // 5: spends 0.3, fee 0.01
+            {{ours(2, 3)},
+             {ours("0.04"), other("0.05"), other("0.1"), ours("0.1")}},
+            // 6: receives 1.6
+            {{funds("3.01"), funds("0.1")},
+             {other("0.5"), other("0.5"), ours("0.6"), ours("1"), other("0.5")}},
+            // 7: spends 1.94, fee 0.05
+            {{ours(3, 2), ours(5, 0), ours(1, 1), ours(5, 3), ours(4, 3)},
+             {ours("0.09"), ours("0.2"), other("1.5"), other("0.1")}},
+            // 8: receives 1.1
+            {{funds("1.41"), funds("0.1"), funds("0.1")},
+             {other("0.5"), ours("0.1"), ours("1")}},
+            // 9: spends 1.26, fee 0.04
+            {{ours(2, 1), ours(4, 1), ours(2, 5), ours(1, 0)},
+             {ours("0.02"), other("1.1"), other("0.1")}},
+            // 10: spends 3.011, fee 0.03
+            {{ours(8, 2), ours(7, 0), ours(7, 1), ours(9, 0),
+              ours(6, 2), ours(8, 1), ours(6, 3), ours(2, 0)},
+             {other("2.681"), other("0.1"), other("0.1"), other("0.1")}},
+            // 11: receives 0.48
+            {{funds("0.39"), funds("0.1")},
+             {ours("0.08"), ours("0.4")}},
+            // 12: receives 4.8
+            {{funds("6.61"), funds("0.1"), funds("0.1")},
+             {other("0.5"), other("0.5"), ours("0.8"), ours("4"), other("0.5"), other("0.5")}},
+            // 13: spends 0.4, fee 0.02
+            {{ours(11, 1)},
+             {other("0.18"), ours("0.1"), other("0.1")}},
+            // 14: receives 2.49
+            {{funds("2.9"), funds("0.1")},
+             {other("0.5"), ours("0.09"), ours("0.4"), ours("2")}},
+            // 15: spends 4.08, fee 0.01
+            {{ours(11, 0), ours(12, 3)},
+             {ours("0.03"), other("1.14"), other("0.1"), ours("0.7"), other("0.1"), ours("2")}},
+            // 16: spends 2, fee 0.03655
+            {{ours(14, 3)},
+             {other("0.62345"), other("0.1"), other("0.1"), other("0.1"),
+              ours("0.04"), other("0.1"), ours("0.8"), other("0.1")}},
+            // 17: spends 4.56, fee 0.19
+            {{ours(14, 1), ours(15, 3), ours(15, 0), ours(12, 2),
+              ours(13, 1), ours(15, 5), ours(16, 4), ours(16, 6)},
+             {ours("0.07"), ours("0.3"), other("4")}},
+            // 18: spends 0.77, fee 0.01
+            {{ours(14, 2), ours(17, 1), ours(17, 0)},
+             {other("0.66"), other("0.1")}},
+    };
+
+
+    /**
+     * Payment ids of some example txs, for checking --find-payment-id.
+     * Tx 1 has an encrypted one (16 hex chars), tx 6 a plain one.
+     */
+    const map<uint64_t, string> EXAMPLE_PAYMENT_IDS {
+            {1, "1234567890abcdef"},
+            {6, "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"}
+    };
+
+
+    /**
+     * Tx after the example txs, without a public key in its
+     * extra, as some old txs on the mainnet. It is not ours,
+     * but scanning all blocks must not fail on it.
+     */
+    const planned_tx TX_WITHOUT_PUB_KEY {
+            {funds("1.2")},
+            {other("1"), other("0.19")}
+    };
+
+
+    /**
+     * Output already in the chain, with what is
+     * needed to spend it in a later tx.
+     */
+    struct chain_output
+    {
+        uint64_t          amount;
+        uint64_t          global_idx;
+        crypto::key_image key_image;
+    };
+
+
+    /**
+     * Makes txs and blocks of the test blockchain. It keeps track
+     * of global output indices, in the same order as BlockchainDB
+     * assigns them, i.e., miner tx of a block first, and then its txs.
+     */
+    class TestChainBuilder {
+
+        account_keys m_wallet_keys;
+
+        // amount -> number of outputs with it so far
+        map<uint64_t, uint64_t> m_no_of_outputs;
+
+        // (example tx no, output index) -> our output
+        map<pair<uint64_t, uint64_t>, chain_output> m_our_outputs;
+
+        // miner tx outputs to be spent by the next block
+        deque<chain_output> m_funding_outputs;
+
+    public:
+        TestChainBuilder(const account_keys& wallet_keys):
+                m_wallet_keys(wallet_keys)
+        {}
+
+
+        /**
+         * Miner tx with one output for each of the given amounts.
+         * They fund the txs of the next block.
+         */
+        bool
+        make_miner_tx(uint64_t height,
+                      const vector<uint64_t>& amounts,
+                      transaction& tx)
+        {
+            tx = transaction {};
+
+            tx.version     = 1;
+            tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+
+            txin_gen in;
+            in.height = height;
+
+            tx.vin.push_back(in);
+
+            add_tx_pub_key_to_extra(tx, keypair::generate().pub);
+
+            for (const uint64_t& amount: amounts)
+            {
+                tx.vout.push_back(make_output(amount, keypair::generate().pub));
+
+                chain_output funding_output {amount, next_global_idx(amount),
+                                             random_key_image()};
+
+                m_funding_outputs.push_back(funding_output);
+            }
+
+            return true;
+        }
+
+
+        /**
+         * Example tx with the planned inputs and outputs. Outputs
+         * that are ours are sent to the wallet's address, in the
+         * same way as wallets do it.
+         *
+         * Without the tx public key in extra, none
+         * of the outputs can be ours.
+         */
+        bool
+        make_example_tx(uint64_t tx_no,
+                        const planned_tx& planned,
+                        transaction& tx,
+                        bool with_tx_pub_key = true)
+        {
+            tx = transaction {};
+
+            tx.version     = 1;
+            tx.unlock_time = 0;
+
+            keypair tx_key = keypair::generate();
+
+            if (with_tx_pub_key)
+            {
+                add_tx_pub_key_to_extra(tx, tx_key.pub);
+            }
+
+            auto payment_id_it = EXAMPLE_PAYMENT_IDS.find(tx_no);
+
+            if (payment_id_it != EXAMPLE_PAYMENT_IDS.end()
+                && !add_payment_id(payment_id_it->second, tx_key.sec, tx))
+            {
+                cerr << "Cant add payment id to tx no " << tx_no << endl;
+                return false;
+            }
+
+            for (const planned_input& planned_in: planned.inputs)
+            {
+                chain_output spent;
+
+                if (planned_in.is_ours)
+                {
+                    auto it = m_our_outputs.find({planned_in.tx_no,
+                                                  planned_in.out_idx});
+
+                    if (it == m_our_outputs.end())
+                    {
+                        cerr << "Tx no " << tx_no << " spends unknown output "
+                             << planned_in.out_idx << " of tx no "
+                             << planned_in.tx_no << endl;
+                        return false;
+                    }
+
+                    spent = it->second;
+                }
+                else
+                {
+                    uint64_t amount;
+
+                    if (!parse_amount(amount, planned_in.amount)
+                        || m_funding_outputs.empty()
+                        || m_funding_outputs.front().amount != amount)
+                    {
+                        cerr << "No funding output for tx no " << tx_no << endl;
+                        return false;
+                    }
+
+                    spent = m_funding_outputs.front();
+                    m_funding_outputs.pop_front();
+                }
+
+                txin_to_key in;
+
+                in.amount      = spent.amount;
+                in.k_image     = spent.key_image;
+
+                // ring with only the real output, so the
+                // relative offset is its global index
+                in.key_offsets.push_back(spent.global_idx);
+
+                tx.vin.push_back(in);
+
+                // the database does not check signatures, so
+                // empty ones, one per ring member, are enough
+                tx.signatures.push_back(
+                        vector<crypto::signature>(in.key_offsets.size()));
+            }
+
+            crypto::key_derivation derivation;
+
+            if (!crypto::generate_key_derivation(
+                    m_wallet_keys.m_account_address.m_view_public_key,
+                    tx_key.sec, derivation))
+            {
+                cerr << "Cant generate derivation for tx no " << tx_no << endl;
+                return false;
+            }
+
+            for (size_t i = 0; i < planned.outputs.size(); ++i)
+            {
+                uint64_t amount;
+
+                if (!parse_amount(amount, planned.outputs[i].amount))
+                {
+                    cerr << "Cant parse amount: " << planned.outputs[i].amount << endl;
+                    return false;
+                }
+
+                if (planned.outputs[i].is_ours && !with_tx_pub_key)
+                {
+                    cerr << "Tx no " << tx_no << " without public key "
+                         << "can't have our outputs" << endl;
+                    return false;
+                }
+
+                if (!planned.outputs[i].is_ours)
+                {
+                    tx.vout.push_back(make_output(amount, keypair::generate().pub));
+                    next_global_idx(amount);
+                    continue;
+                }
+
+                crypto::public_key out_key;
+
+                crypto::derive_public_key(derivation, i,
+                                          m_wallet_keys.m_account_address.m_spend_public_key,
+                                          out_key);
+
+                tx.vout.push_back(make_output(amount, out_key));
+
+                keypair in_ephemeral;
+                crypto::key_image key_image;
+
+                if (!generate_key_image_helper(m_wallet_keys, tx_key.pub, i,
+                                               in_ephemeral, key_image))
+                {
+                    cerr << "Cant generate key image for tx no " << tx_no << endl;
+                    return false;
+                }
+
+                m_our_outputs[{tx_no, i}] = {amount, next_global_idx(amount), key_image};
+            }
+
+            return true;
+        }
+
+    private:
+        /**
+         * Add payment id in the extra nonce, as wallets do it.
+         * Encrypted ones are encrypted with the tx secret key
+         * and our public view key, so only we can read them.
+         */
+        bool
+        add_payment_id(const string& payment_id_str,
+                       const crypto::secret_key& tx_sec_key,
+                       transaction& tx) const
+        {
+            crypto::hash payment_id;
+            bool         encrypted;
+
+            if (!xmreg::parse_str_payment_id(payment_id_str, payment_id, encrypted))
+            {
+                return false;
+            }
+
+            blobdata extra_nonce;
+
+            if (encrypted)
+            {
+                crypto::hash8 payment_id8;
+
+                memcpy(&payment_id8, &payment_id, sizeof(payment_id8));
+
+                if (!encrypt_payment_id(payment_id8,
+                                        m_wallet_keys.m_account_address.m_view_public_key,
+                                        tx_sec_key))
+                {
+                    return false;
+                }
+
+                set_encrypted_payment_id_to_tx_extra_nonce(extra_nonce, payment_id8);
+            }
+            else
+            {
+                set_payment_id_to_tx_extra_nonce(extra_nonce, payment_id);
+            }
+
+            return add_extra_nonce_to_tx_extra(tx.extra, extra_nonce);
+        }
+
+        tx_out
+        make_output(uint64_t amount, const crypto::public_key& out_key) const
+        {
+            tx_out out;
+
+            out.amount = amount;
+            out.target = txout_to_key(out_key);
+
+            return out;
+        }
+
+        uint64_t
+        next_global_idx(uint64_t amount)
+        {
+            return m_no_of_outputs[amount]++;
+        }
+
+        // key images of outputs that are not ours only
+        // need to be unique, so any public key will do
+        crypto::key_image
+        random_key_image() const
+        {
+            crypto::public_key pub_key = keypair::generate().pub;
+
+            crypto::key_image key_image;
+
+            memcpy(&key_image, &pub_key, sizeof(key_image));
+
+            return key_image;
+        }
+    };
+
+
+    /**
+     * Amounts of the inputs of a planned tx that are not ours
+     */
+    bool
+    get_funding_amounts(const planned_tx& planned, vector<uint64_t>& amounts)
+    {
+        for (const planned_input& planned_in: planned.inputs)
+        {
+            if (planned_in.is_ours)
+            {
+                continue;
+            }
+
+            uint64_t amount;
+
+            if (!parse_amount(amount, planned_in.amount))
+            {
+                cerr << "Cant parse amount: " << planned_in.amount << endl;
+                return false;
+            }
+
+            amounts.push_back(amount);
+        }
+
+        return true;
+    }
+}
+
+
+/**
+ * Makes a small lmdb blockchain with the example txs of the README,
+ * sent to and from the example wallet, and writes their hashes into
+ * tx_hashes.txt in the same folder.
+ *
+ * Example tx no n is in the block at height n, and its
+ * inputs that are not ours spend the miner tx of the block before.
+ * The last block has a tx without a public key.
+ *
+ * The blocks are not valid for the real network, e.g., there is no
+ * proof of work or signatures, but BlockchainDB does not check this,
+ * and the scanning only needs what is stored.
+ */
+int main(int ac, const char* av[]) {
+
+    if (ac != 2)
+    {
+        cerr << "Usage: " << av[0] << " <blockchain folder>" << endl;
+        return 1;
+    }
+
+    bf::path blockchain_path {av[1]};
+
+    // blocks are added on top of existing ones,
+    // so always start with an empty folder
+    bf::remove_all(blockchain_path);
+    bf::create_directories(blockchain_path);
+
+    // the example wallet keys, as in main.cpp
+    account_keys wallet_keys;
+
+    if (!xmreg::parse_str_secret_key(
+                "9c2edec7636da3fbb343931d6c3d6e11bcd8042ff7e11de98a8d364f31976c04",
+                wallet_keys.m_view_secret_key)
+        || !xmreg::parse_str_secret_key(
+                "950b90079b0f530c11801ef29e99618d3768d79d3d24972ff4b6fd9687b7b20c",
+                wallet_keys.m_spend_secret_key))
+    {
+        return 1;
+    }
+
+    crypto::secret_key_to_public_key(wallet_keys.m_view_secret_key,
+                                      wallet_keys.m_account_address.m_view_public_key);
+    crypto::secret_key_to_public_key(wallet_keys.m_spend_secret_key,
+                                      wallet_keys.m_account_address.m_spend_public_key);
+
+    ofstream tx_hashes_file {(blockchain_path / "tx_hashes.txt").string()};
+
+    if (!tx_hashes_file.is_open())
+    {
+        cerr << "Cant create tx hashes file in: " << blockchain_path << endl;
+        return 1;
+    }
+
+    BlockchainLMDB db;
+
+    try
+    {
+        db.open(blockchain_path.string());
+    }
+    catch (const std::exception& e)
+    {
+        cerr << "Error opening database: " << e.what() << endl;
+        return 1;
+    }
+
+    TestChainBuilder chain_builder {wallet_keys};
+
+    // tx no n is in the block at height n
+    vector<planned_tx> planned_txs {EXAMPLE_TXS};
+
+    planned_txs.push_back(TX_WITHOUT_PUB_KEY);
+
+    crypto::hash prev_id         {null_hash};
+    uint64_t     coins_generated {0};
+
+    for (uint64_t height = 0; height <= planned_txs.size(); ++height)
+    {
+        vector<transaction> txs;
+
+        // outputs for the planned tx in the next block
+        vector<uint64_t> funding_amounts;
+
+        if (height < planned_txs.size()
+            && !get_funding_amounts(planned_txs[height], funding_amounts))
+        {
+            return 1;
+        }
+
+        block blk;
+
+        blk.major_version = 1;
+        blk.minor_version = 0;
+        blk.timestamp     = 1420070400 + height * 60;
+        blk.prev_id       = prev_id;
+        blk.nonce         = 0;
+
+        // miner tx first, as its outputs get global
+        // indices before outputs of the block's txs
+        if (!chain_builder.make_miner_tx(height, funding_amounts, blk.miner_tx))
+        {
+            return 1;
+        }
+
+        if (height > 0)
+        {
+            // only the example txs are ours and have public keys
+            bool is_example_tx = height <= EXAMPLE_TXS.size();
+
+            transaction tx;
+
+            if (!chain_builder.make_example_tx(height, planned_txs[height - 1],
+                                               tx, is_example_tx))
+            {
+                return 1;
+            }
+
+            txs.push_back(tx);
+
+            if (is_example_tx)
+            {
+                tx_hashes_file << epee::string_tools::pod_to_hex(
+                        get_transaction_hash(tx)) << "\n";
+            }
+        }
+
+        for (const transaction& tx: txs)
+        {
+            blk.tx_hashes.push_back(get_transaction_hash(tx));
+        }
+
+        for (const uint64_t& amount: funding_amounts)
+        {
+            coins_generated += amount;
+        }
+
+        try
+        {
+            db.add_block(blk, get_object_blobsize(blk),
+                         height + 1, coins_generated, txs);
+        }
+        catch (const std::exception& e)
+        {
+            cerr << "Cant add block at height " << height
+                 << ": " << e.what() << endl;
+            return 1;
+        }
+
+        prev_id = get_block_hash(blk);
+    }
+
+    db.close();
+
+    cout << "Test blockchain with " << planned_txs.size() + 1
+         << " blocks written into " << blockchain_path << endl;
+
+    return 0;
+}